@@ -0,0 +1,14 @@
+#include <cstdlib>
+#include <new>
+
+#include "bench.h"
+
+std::size_t n_allocs = 0;
+
+void * operator new(std::size_t n){
+    ++n_allocs;
+    if(auto p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc{};
+}
+void operator delete(void * p) noexcept { std::free(p); }
+void operator delete(void * p , std::size_t) noexcept { std::free(p); }
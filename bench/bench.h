@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <benchmark/benchmark.h>
+
+// allocations made by the benchmark binary , counted by its replaced operator new
+extern std::size_t n_allocs;
+
+// run body once per iteration , report evaluations per second and allocations per iteration ,
+// pass no evaluations for work that evaluates nothing
+template<class F>
+void measure(benchmark::State & state , std::size_t evals_per_iteration , F && body){
+    std::size_t allocs = 0;
+    for(auto _ : state){
+        auto before = n_allocs;
+        body();
+        allocs += n_allocs - before;
+    }
+    if(evals_per_iteration)
+        state.counters["evals/s"] = benchmark::Counter(
+            static_cast<double>(state.iterations() * evals_per_iteration) , benchmark::Counter::kIsRate);
+    state.counters["allocs"] = benchmark::Counter(
+        static_cast<double>(allocs) , benchmark::Counter::kAvgIterations);
+}
@@ -0,0 +1,102 @@
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+
+#include "bench.h"
+#include "runtime.h"
+
+using namespace lispy;
+
+namespace {
+
+void define_peano(){
+    Runtime::eval(R"(
+        (define +
+            (lambda (n m)
+            (cond
+                ((zero? m) n)
+                (else (add1 (+ n (sub1 m)))))))
+    )");
+    Runtime::eval(R"(
+        (define -
+            (lambda (n m)
+            (cond
+                ((zero? m) n)
+                (else (sub1 (- n (sub1 m)))))))
+    )");
+    Runtime::eval(R"(
+        (define >
+            (lambda (n m)
+            (cond
+                ((zero? n) #f)
+                ((zero? m) #t)
+                (else (> (sub1 n) (sub1 m))))))
+    )");
+    Runtime::eval(R"(
+        (define <
+            (lambda (n m)
+            (cond
+                ((zero? m) #f)
+                ((zero? n) #t)
+                (else (< (sub1 n) (sub1 m))))))
+    )");
+    Runtime::eval(R"(
+        (define =
+            (lambda (n m)
+            (cond
+                ((> n m) #f)
+                ((< n m) #f)
+                (else #t))))
+    )");
+}
+
+void define_y_fibb(){
+    Runtime::eval(R"(
+        (define Y
+            (lambda (F)
+            ((lambda (f)
+                (lambda (n)
+                ((F (f f)) n)))
+            (lambda (f)
+                (lambda (n)
+                ((F (f f)) n))))))
+    )");
+    Runtime::eval(R"(
+        (define fibb
+            (lambda (fib)
+            (lambda (n)
+                (cond
+                    ((= n 0) 0)
+                    ((= n 1) 1)
+                    (else (+ (fib (- n 1)) (fib (- n 2))))))))
+    )");
+}
+
+void define_all(){
+    static bool defined = (define_peano() , define_y_fibb() , true);
+    benchmark::DoNotOptimize(defined);
+}
+
+void bm_y_fibb(benchmark::State & state){
+    define_all();
+    auto input = fmt::format("((Y fibb) {})" , state.range(0));
+    measure(state , 1 , [&]{
+        benchmark::DoNotOptimize(Runtime::eval(input));
+    });
+}
+
+void bm_peano(benchmark::State & state , const char * op){
+    define_all();
+    auto n = state.range(0);
+    auto input = fmt::format("({} {} {})" , op , n , n);
+    measure(state , 1 , [&]{
+        benchmark::DoNotOptimize(Runtime::eval(input));
+    });
+    state.SetComplexityN(n);
+}
+
+}
+
+BENCHMARK(bm_y_fibb)->DenseRange(10 , 25 , 5)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(bm_peano , + , "+")->RangeMultiplier(10)->Range(100 , 100'000)->Complexity(benchmark::oN);
+BENCHMARK_CAPTURE(bm_peano , - , "-")->RangeMultiplier(10)->Range(100 , 100'000)->Complexity(benchmark::oN);
+BENCHMARK_CAPTURE(bm_peano , < , "<")->RangeMultiplier(10)->Range(100 , 100'000)->Complexity(benchmark::oN);
@@ -0,0 +1,69 @@
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+
+#include "bench.h"
+#include "runtime.h"
+
+using namespace lispy;
+
+namespace {
+
+void define_list_functions(){
+    Runtime::eval(R"(
+        (define build
+            (lambda (n acc)
+            (cond
+                ((zero? n) acc)
+                (else (build (sub1 n) (cons n acc))))))
+    )");
+    Runtime::eval(R"(
+        (define lat?
+            (lambda (l)
+            (cond
+                ((null? l) #t)
+                ((atom? (car l)) (lat? (cdr l)))
+                (else #f))))
+    )");
+    Runtime::eval(R"(
+        (define member?
+            (lambda (a lat)
+            (cond
+                ((null? lat) #f)
+                (else (or (eq? (car lat) a) (member? a (cdr lat)))))))
+    )");
+    Runtime::eval(R"(
+        (define rember
+            (lambda (a lat)
+            (cond
+                ((null? lat) '())
+                ((eq? (car lat) a) (cdr lat))
+                (else (cons (car lat) (rember a (cdr lat)))))))
+    )");
+}
+
+// (1 2 ... n) bound to bench-lat , every call below walks all of it
+void bm_lat(benchmark::State & state , const char * call){
+    static bool defined = (define_list_functions() , true);
+    benchmark::DoNotOptimize(defined);
+
+    auto n = state.range(0);
+    Runtime::eval(fmt::format("(define bench-lat (build {} '()))" , n));
+    auto input = fmt::format(fmt::runtime(call) , n);
+    measure(state , 1 , [&]{
+        benchmark::DoNotOptimize(Runtime::eval(input));
+    });
+    state.SetComplexityN(n);
+}
+
+}
+
+BENCHMARK_CAPTURE(bm_lat , lat? , "(lat? bench-lat)")
+    ->RangeMultiplier(4)->Range(1 << 10 , 1 << 16)->Arg(100'000)->Complexity(benchmark::oN);
+BENCHMARK_CAPTURE(bm_lat , member? , "(member? {} bench-lat)")
+    ->RangeMultiplier(4)->Range(1 << 10 , 1 << 16)->Arg(100'000)->Complexity(benchmark::oN);
+// removes the last element , so every cell is consed again
+BENCHMARK_CAPTURE(bm_lat , rember , "(null? (rember {} bench-lat))")
+    ->RangeMultiplier(4)->Range(1 << 10 , 1 << 16)->Arg(100'000)->Complexity(benchmark::oN);
+// builds a list and drops it , the allocation heavy case to compare a GC=1 build against the refcounted one
+BENCHMARK_CAPTURE(bm_lat , build , "(null? (build {} '()))")
+    ->RangeMultiplier(4)->Range(1 << 10 , 1 << 16)->Arg(1'000'000)->Complexity(benchmark::oN);
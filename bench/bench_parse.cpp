@@ -0,0 +1,57 @@
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+
+#include "ast.h"
+#include "bench.h"
+#include "structural.h"
+
+using namespace lispy;
+
+namespace {
+
+// a quoted list of n small lists mixing every token kind
+std::string large_input(std::size_t n){
+    std::string input = "(define data '(";
+    for(std::size_t i = 0 ; i < n ; ++i)
+        input += fmt::format("(item-{} {} #t 'sym (nested (list -{})))\n" , i , i , i);
+    input += "))";
+    return input;
+}
+
+// bytes_per_second is the throughput of the parser
+void bm_parse(benchmark::State & state , std::optional<ast::SExpr> (*parse)(std::string_view)){
+    auto input = large_input(state.range(0));
+    measure(state , 0 , [&]{
+        benchmark::DoNotOptimize(parse(input));
+    });
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * input.size()));
+    state.SetComplexityN(state.range(0));
+}
+
+// the first stage alone , classifying and listing the tokens
+void bm_index(benchmark::State & state , structural::isa isa){
+    auto input = large_input(state.range(0));
+    std::vector<uint32_t> tokens{};
+    measure(state , 0 , [&]{
+        structural::indexer index{input , isa};
+        while(index.next(tokens)) benchmark::DoNotOptimize(tokens.data());
+    });
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * input.size()));
+}
+
+}
+
+BENCHMARK_CAPTURE(bm_index , scalar , structural::isa::scalar)->Arg(100'000);
+BENCHMARK_CAPTURE(bm_index , sse2 , structural::isa::sse2)->Arg(100'000);
+BENCHMARK_CAPTURE(bm_index , avx2 , structural::isa::avx2)->Arg(100'000);
+
+BENCHMARK_CAPTURE(bm_parse , reader , ast::parse)
+    ->RangeMultiplier(10)->Range(10 , 100'000)->Complexity(benchmark::oN);
+BENCHMARK_CAPTURE(bm_parse , indexed , [](std::string_view in){ return structural::parse(in); })
+    ->RangeMultiplier(10)->Range(10 , 100'000)->Complexity(benchmark::oN);
+BENCHMARK_CAPTURE(bm_parse , indexed_scalar , [](std::string_view in){ return structural::parse(in , structural::isa::scalar); })
+    ->RangeMultiplier(10)->Range(10 , 100'000)->Complexity(benchmark::oN);
+BENCHMARK_CAPTURE(bm_parse , combinators , ast::parse_combinators)
+    ->RangeMultiplier(10)->Range(10 , 100'000)->Complexity(benchmark::oN);
@@ -0,0 +1,24 @@
+#include <string>
+#include <benchmark/benchmark.h>
+
+#include "parser/experimental/parser.h"
+#include "inputs.h"
+
+namespace {
+
+// [1,-22,333 ...]
+void bm_experimental_ints(benchmark::State & state){
+    auto input = inputs::integers(state.range(0) , '[' , ',' , ']');
+    inputs::run(state , input , ints<int>);
+}
+
+// a single word of letters
+void bm_experimental_word(benchmark::State & state){
+    std::string input(state.range(0) , 'w');
+    inputs::run(state , input , word);
+}
+
+}
+
+BENCHMARK(bm_experimental_ints)->Apply(inputs::up_to<100'000'000>);
+BENCHMARK(bm_experimental_word)->Apply(inputs::up_to<100'000'000>);
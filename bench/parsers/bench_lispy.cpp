@@ -0,0 +1,51 @@
+#include <optional>
+#include <benchmark/benchmark.h>
+
+#include "ast.h"
+#include "parsec.h"
+#include "inputs.h"
+
+using namespace lispy;
+
+namespace {
+
+using parse_fn = std::optional<ast::SExpr> (*)(std::string_view);
+using generate_fn = std::string (*)(std::size_t);
+
+// ast::parse , and the same grammar in pscpp v1 combinators
+void bm_sexpr(benchmark::State & state , parse_fn parse , generate_fn generate){
+    auto input = generate(state.range(0));
+    inputs::run(state , input , parse);
+}
+
+// the integer parsers of test_v1.cpp , over a list of them
+constexpr int to_int(std::string_view nums){
+    int n = 0;
+    for(auto c : nums) n = n * 10 + (c - '0');
+    return n;
+}
+auto natural  = pscpp::fmap(to_int , pscpp::chars(pscpp::digit));
+auto negative = pscpp::fmap(std::negate<int>{} , (pscpp::onechar('-') >> natural));
+auto numbers  = negative | natural;
+auto int_list = pscpp::onechar('(') >> pscpp::sepby(numbers , pscpp::spaces1) << pscpp::onechar(')');
+
+void bm_v1_ints(benchmark::State & state){
+    auto input = inputs::integers(state.range(0));
+    inputs::run(state , input , int_list);
+}
+
+}
+
+// the reader keeps open lists on the heap , the combinators recurse per list
+BENCHMARK_CAPTURE(bm_sexpr , parse/deep , ast::parse , inputs::deep)->Apply(inputs::up_to<10'000'000>);
+BENCHMARK_CAPTURE(bm_sexpr , parse/flat , ast::parse , inputs::flat)->Apply(inputs::up_to<100'000'000>);
+BENCHMARK_CAPTURE(bm_sexpr , parse/symbols , ast::parse , inputs::symbols)->Apply(inputs::up_to<100'000'000>);
+BENCHMARK_CAPTURE(bm_sexpr , parse/integers , ast::parse ,
+    [](std::size_t n){ return inputs::integers(n); })->Apply(inputs::up_to<100'000'000>);
+
+BENCHMARK_CAPTURE(bm_sexpr , v1/deep , ast::parse_combinators , inputs::deep)->Apply(inputs::up_to<1'000'000>);
+BENCHMARK_CAPTURE(bm_sexpr , v1/flat , ast::parse_combinators , inputs::flat)->Apply(inputs::up_to<100'000'000>);
+BENCHMARK_CAPTURE(bm_sexpr , v1/symbols , ast::parse_combinators , inputs::symbols)->Apply(inputs::up_to<100'000'000>);
+BENCHMARK_CAPTURE(bm_sexpr , v1/integers , ast::parse_combinators ,
+    [](std::size_t n){ return inputs::integers(n); })->Apply(inputs::up_to<100'000'000>);
+BENCHMARK(bm_v1_ints)->Apply(inputs::up_to<100'000'000>);
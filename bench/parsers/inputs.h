@@ -0,0 +1,100 @@
+#pragma once
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <benchmark/benchmark.h>
+
+#include "../bench.h"
+
+// generated inputs of the parser benchmarks , about bytes long each
+namespace inputs{
+
+    // sizes every parser is run on , from 1 KB to 100 MB ,
+    // a parser that recurses per element or per character is only run up to the size it survives
+    inline constexpr int64_t sizes[] = {1'000 , 10'000 , 100'000 , 1'000'000 , 10'000'000 , 100'000'000};
+
+    // a list of towers 500 lists deep , the depth stays bounded while the input grows
+    inline std::string deep(std::size_t bytes){
+        constexpr std::size_t depth = 500;
+        std::string s = "(";
+        while(s.size() < bytes){
+            s.append(depth , '(');
+            s += "x";
+            s.append(depth , ')');
+            s += ' ';
+        }
+        s += ')';
+        return s;
+    }
+
+    // (e0 e1 ...) of short symbols
+    inline std::string flat(std::size_t bytes){
+        std::string s = "(";
+        for(std::size_t i = 0 ; s.size() < bytes ; ++i){
+            s += 'e';
+            s += std::to_string(i % 1000);
+            s += ' ';
+        }
+        s += ')';
+        return s;
+    }
+
+    // a list of 1024 distinct symbols , 64 to 964 bytes long
+    inline std::string symbols(std::size_t bytes){
+        std::string s = "(";
+        for(std::size_t i = 0 ; s.size() < bytes ; ++i){
+            s.append(64 + (i % 16) * 60 , "abcdefghijklmnopqrstuvwxyz"[i % 26]);
+            s += std::to_string(i % 1024);
+            s += ' ';
+        }
+        s += ')';
+        return s;
+    }
+
+    // open , the integers separated by sep , close : (1 -22 333) or [1,-22,333]
+    inline std::string integers(std::size_t bytes , char open = '(' , char sep = ' ' , char close = ')'){
+        std::string s(1 , open);
+        for(std::size_t i = 0 ; s.size() < bytes ; ++i){
+            if(i) s += sep;
+            s += std::to_string(i % 2 ? -int64_t(i % 100'000) : int64_t(i % 100'000));
+        }
+        s += close;
+        return s;
+    }
+
+    // peak resident set size of the process , in KB , since the last reset_peak_rss
+    inline std::size_t peak_rss_kb(){
+        std::ifstream status{"/proc/self/status"};
+        for(std::string line ; std::getline(status , line) ; )
+            if(line.starts_with("VmHWM:")) return std::stoul(line.substr(6));
+        return 0;
+    }
+    inline void reset_peak_rss(){
+        std::ofstream{"/proc/self/clear_refs"} << "5";
+    }
+
+    // runs parse on input once per iteration , reporting MB/s , allocations per KB of input
+    // and the peak RSS , of this run where linux lets clear_refs reset it , of the process so far otherwise
+    template<class F>
+    void run(benchmark::State & state , std::string_view input , F && parse){
+        if(!parse(input)) return state.SkipWithError("input rejected");
+        reset_peak_rss();
+        measure(state , 0 , [&]{
+            benchmark::DoNotOptimize(parse(input));
+        });
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * input.size()));
+        // allocs is summed over the iterations until reported
+        auto allocs = state.counters["allocs"].value / static_cast<double>(state.iterations());
+        state.counters["allocs/KB"] = benchmark::Counter(allocs * 1024.0 / static_cast<double>(input.size()));
+        state.counters["peak_rss_MB"] = benchmark::Counter(static_cast<double>(peak_rss_kb()) / 1024.0);
+    }
+
+    // registers a benchmark for each size up to max_bytes , ->Apply(inputs::up_to<max_bytes>)
+    template<int64_t max_bytes>
+    void up_to(benchmark::internal::Benchmark * b){
+        for(auto n : sizes) if(n <= max_bytes) b->Arg(n);
+        b->Unit(benchmark::kMillisecond);
+    }
+
+}
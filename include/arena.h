@@ -0,0 +1,116 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace lispy{
+
+    // monotonic memory for the temporaries of one top-level form :
+    // allocating bumps a pointer , deallocating does nothing , release frees everything at once.
+    class arena{
+    public:
+        static constexpr std::size_t first_chunk = 64 * 1024;
+        // past max_size() , a form allocates from the heap again , so long loops still free their garbage .
+        // those blocks are still the form's until freed , see owns
+        static constexpr std::size_t default_max_size = 256 * 1024 * 1024;
+        // largest chunk kept across forms
+        static constexpr std::size_t max_retained = 16 * 1024 * 1024;
+
+        explicit arena(std::size_t max_size = default_max_size) noexcept : _max_size(max_size) {}
+        arena(const arena &) = delete;
+        arena & operator=(const arena &) = delete;
+        // blocks from past max_size() still alive are left to the heap , as by release
+        ~arena();
+
+        // null when paused
+        void * allocate(std::size_t n , std::size_t align) noexcept;
+        // whether p came from allocate : nothing to do in the chunks , a block past max_size is freed
+        bool deallocate(void * p) noexcept;
+        // in a chunk , or in a block from past max_size not freed yet
+        bool owns(const void * p) const noexcept;
+        // keeps one chunk for the next form , the largest up to max_retained.
+        // blocks from past max_size() still alive are left to the heap : they came from ::operator new ,
+        // and arena_allocator gives them back there once no arena is current , so they are not freed here
+        void release() noexcept;
+        std::size_t reserved() const noexcept { return _reserved; }
+        std::size_t max_size() const noexcept { return _max_size; }
+
+        // the arena of the running form , null outside Runtime::eval
+        static arena * current() noexcept { return _current; }
+
+        // makes a the current arena until destroyed , and releases it then.
+        // nested scopes keep the outer arena , so a form is released only once it is done.
+        class scope{
+            arena * _owned;
+        public:
+            explicit scope(arena & a) noexcept : _owned(_current ? nullptr : &a) { if(_owned) _current = _owned; }
+            scope(const scope &) = delete;
+            ~scope() { if(_owned){ _current = nullptr; _owned->release(); } }
+        };
+
+        // allocations go to the heap until destroyed , for values that outlive the form
+        class pause{
+            arena * _paused;
+            bool _was;
+        public:
+            pause() noexcept : _paused(_current) , _was(_paused && _paused->_paused) { if(_paused) _paused->_paused = true; }
+            pause(const pause &) = delete;
+            ~pause() { if(_paused) _paused->_paused = _was; }
+        };
+
+    private:
+        struct chunk{
+            std::byte * begin;
+            std::size_t size;
+        };
+        bool grow(std::size_t n) noexcept;
+        void * spill(std::size_t n , std::size_t align) noexcept;
+        bool in_chunks(const void * p) const noexcept;
+
+    private:
+        std::vector<chunk> _chunks{};
+        std::byte * _top{nullptr};
+        std::byte * _end{nullptr};
+        std::size_t _reserved{0};
+        std::size_t _max_size;
+        // blocks allocated from the heap past max_size , size by address
+        std::map<std::uintptr_t , std::size_t> _spilled{};
+        bool _paused{false};
+
+        static inline arena * _current{nullptr};
+    };
+
+    // allocates from the current arena when there is one , from the heap otherwise ,
+    // and gives each pointer back to where it came from.
+    template<class T>
+    struct arena_allocator{
+        using value_type = T;
+
+        arena_allocator() = default;
+        template<class U>
+        arena_allocator(const arena_allocator<U> &) noexcept {}
+
+        T * allocate(std::size_t n){
+            if(auto a = arena::current())
+                if(auto p = a->allocate(n * sizeof(T) , alignof(T))) return static_cast<T *>(p);
+            return std::allocator<T>{}.allocate(n);
+        }
+        void deallocate(T * p , std::size_t n) noexcept{
+            if(auto a = arena::current() ; a && a->deallocate(p)) return;
+            std::allocator<T>{}.deallocate(p , n);
+        }
+
+        template<class U>
+        bool operator ==(const arena_allocator<U> &) const noexcept { return true; }
+    };
+
+    // whether a block allocated at p may come to hold what the running form allocates :
+    // blocks outliving the form must not point into its arena
+    inline bool may_hold_temporaries(const void * p) noexcept{
+        auto a = arena::current();
+        return !a || a->owns(p);
+    }
+
+}
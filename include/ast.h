@@ -1,44 +1,582 @@
 #pragma once
+#include <algorithm>
+#include <concepts>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <string>
 #include <string_view>
 #include <variant>
 #include <optional>
+#include <memory>
+#include <ranges>
+#include <span>
 
+#include "arena.h"
 #include "constexpr_containers.hpp"
 #include "utils.hpp"
 
 namespace lispy{
 
+namespace vm{
+    struct Function;
+}
+
+namespace gc{
+    class tracer;
+    class heap;
+}
+
+class Closure;
+
 namespace ast{
     
     struct SExpr;
 
-    using Symbol    = std::string_view ;
-    using Quote     = cexpr::cow<SExpr>;
-    using List      = cexpr::cow<cexpr::vector<SExpr>>;
+    // containers of runtime values , temporaries of Runtime::eval live in its arena.
+    // call forms and frames mostly hold up to 4 values , those stay inline.
+    template<class T , std::size_t N = 4>
+    using vector = cexpr::small_vector<T , N , arena_allocator<T>>;
+    // parameters , bound arguments and captures of a lambda , rarely more than 2
+    template<class T>
+    using short_vector = vector<T , 2>;
+    template<class T>
+    using cow = cexpr::cow<T , arena_allocator<T>>;
+
+    // interned name : equal symbols share one string that lives as long as the program ,
+    // so they compare by address and never point into the parsed input.
+    class Symbol{
+        const std::string * _name;
+
+        friend struct SExpr;
+        explicit Symbol(const std::string * name) noexcept : _name(name) {}
+    public:
+        Symbol(std::string_view name);
+        Symbol(const char * name) : Symbol(std::string_view{name}) {}
+
+        std::string_view name() const noexcept { return *_name; }
+        operator std::string_view() const noexcept { return *_name; }
+
+        bool operator ==(const Symbol & rhs) const noexcept { return _name == rhs._name; }
+        bool operator ==(std::string_view rhs) const noexcept { return *_name == rhs; }
+        bool operator ==(const char * rhs) const noexcept { return *_name == rhs; }
+
+        std::size_t hash() const noexcept { return std::hash<const std::string *>{}(_name); }
+    };
 
     using Boolean   = bool;
     using Integer   = int64_t;
     // using String    = std::string;
 
+    struct Quote;
+    class List;
+    struct Lambda;
+    struct BuiltinFn;
+    struct LocalRef;
+    struct CaptureRef;
+    struct GlobalRef;
+    struct LambdaForm;
+    struct LambdaCode;
+
+    // alternatives of SExpr , in the order SExpr::index reports them
+    enum class kind : uint8_t {
+        integer , boolean , symbol , quote , list , lambda ,
+        builtin , local_ref , capture_ref , global_ref , lambda_form ,
+    };
+
+    template<class T , class ...Ts>
+    constexpr std::size_t index_of = [] {
+        std::size_t i = 0;
+        ((std::is_same_v<T , Ts> ? false : (++i , true)) && ...);
+        return i;
+    }();
+
+    template<class T>
+    constexpr std::size_t alternative_index = index_of<T ,
+        Integer , Boolean , Symbol , Quote , List , Lambda ,
+        BuiltinFn , LocalRef , CaptureRef , GlobalRef , LambdaForm>;
+
+    template<class T>
+    constexpr kind kind_of = static_cast<kind>(alternative_index<T>);
+
+    // alternatives kept behind a pointer , integers too large for a fixnum as well
+    template<class T>
+    concept heap_value = alternative_index<T> > std::size_t(kind::symbol)
+                      && alternative_index<T> <= std::size_t(kind::lambda_form);
+
+#ifdef LISPY_GC
+}
+namespace gc{
+    // bump allocation in the collected heap , see gc.h
+    void * allocate(std::size_t bytes);
+}
+namespace ast{
+
+    // header of a value on the collected heap , the value follows it ( see Boxed ) .
+    // size is set once the value is constructed , the collector walks its regions by it
+    struct Object{
+        uint32_t size{0};
+        kind type;
+        mutable bool marked{false};
+    };
+#else
+    // refcounted header of a value on the heap , the value follows it ( see Boxed )
+    struct Object{
+        cexpr::ref_count_biased_t count{};
+        kind type;
+    };
+#endif
+    static_assert(sizeof(Object) == 8);
+
+    template<class T>
+    struct Boxed : Object{
+        T value;
+
+        template<class ...Args>
+        explicit Boxed(Args && ...args)
+        : Object{.type = kind_of<T>} , value(std::forward<Args>(args)...) {}
+    };
+
+    // one machine word , the low bits tell what it holds :
+    //   ...1  fixnum , the integer shifted left by one
+    //   .010  boolean , its value in bit 3
+    //   .100  symbol , the address of its interned name
+    //   .000  address of an Object , integers that do not fit a fixnum included
+    // copies share the Object , values are immutable once stored , see mut for the exception.
+    struct SExpr{
+        SExpr() noexcept : _bits(fixnum_bits(0)) {}
+        // exactly a Boolean , pointers and integers do not convert
+        template<std::same_as<Boolean> B>
+        SExpr(B b) noexcept : _bits(b ? true_bits : false_bits) {}
+        template<std::integral I>
+        requires (!std::same_as<I , Boolean>)
+        SExpr(I i) : _bits(from_integer(static_cast<Integer>(i))) {}
+        SExpr(Symbol s) noexcept : _bits(reinterpret_cast<uintptr_t>(s._name) | symbol_tag) {}
+        template<class T>
+        requires heap_value<std::remove_cvref_t<T>> && std::constructible_from<std::remove_cvref_t<T> , T>
+        SExpr(T && value) : _bits(address(allocate<std::remove_cvref_t<T>>(std::forward<T>(value)))) {}
+
+        SExpr(const SExpr & e) noexcept : _bits(e._bits) { retain(); }
+        SExpr(SExpr && e) noexcept : _bits(std::exchange(e._bits , fixnum_bits(0))) {}
+        SExpr & operator =(const SExpr & e) noexcept {
+            SExpr copy{e};
+            std::swap(_bits , copy._bits);
+            return *this;
+        }
+        SExpr & operator =(SExpr && e) noexcept {
+            std::swap(_bits , e._bits);
+            return *this;
+        }
+        ~SExpr() { release(); }
+
+        kind type() const noexcept {
+            if(_bits & 1) return kind::integer;
+            switch(_bits & tag_mask){
+            case boolean_tag : return kind::boolean;
+            case symbol_tag  : return kind::symbol;
+            default          : return object()->type;
+            }
+        }
+        std::size_t index() const noexcept { return static_cast<std::size_t>(type()); }
+
+        template<class T>
+        bool holds() const noexcept {
+            if constexpr (std::is_same_v<T , Integer>)
+                return (_bits & 1) || (is_object() && object()->type == kind::integer);
+            else if constexpr (std::is_same_v<T , Boolean>)
+                return (_bits & tag_mask) == boolean_tag;
+            else if constexpr (std::is_same_v<T , Symbol>)
+                return (_bits & tag_mask) == symbol_tag;
+            else
+                return is_object() && object()->type == kind_of<T>;
+        }
+        template<class ...T>
+        bool holds_one_of() const noexcept { return (holds<T>() || ...); }
+
+        // T must be held . immediates come by value , the others by reference to the shared Object
+        template<class T>
+        decltype(auto) get() const noexcept {
+            if constexpr (std::is_same_v<T , Integer>)
+                return (_bits & 1) ? static_cast<Integer>(_bits) >> 1 : boxed<Integer>();
+            else if constexpr (std::is_same_v<T , Boolean>)
+                return _bits == true_bits;
+            else if constexpr (std::is_same_v<T , Symbol>)
+                return Symbol{reinterpret_cast<const std::string *>(_bits & ~tag_mask)};
+            else
+                return boxed<T>();
+        }
+        // an optional for immediates , a pointer otherwise
+        template<class T>
+        auto get_if() const noexcept {
+            if constexpr (heap_value<T>)
+                return holds<T>() ? &boxed<T>() : nullptr;
+            else
+                return holds<T>() ? std::optional<T>{get<T>()} : std::nullopt;
+        }
+        // the held T , copied first if another SExpr shares it
+        template<class T>
+        requires heap_value<T>
+        T & mut() {
+#ifdef LISPY_GC
+            // nothing counts the sharers of a collected Object
+            CEXPR_COUNT(cow_clones);
+            *this = SExpr{boxed<T>()};
+#else
+            if(object()->count.cnt() != 1){
+                CEXPR_COUNT(cow_clones);
+                *this = SExpr{boxed<T>()};
+            }
+#endif
+            return const_cast<T &>(boxed<T>());
+        }
+
+        // a new closure of code , holding n_captures captured values then n_bounded bound arguments in its Object .
+        // fill gets them as one span , to assign them in place of the zeros they start as
+        template<class Fill>
+        static SExpr lambda(cow<LambdaCode> code , std::size_t n_captures , std::size_t n_bounded , Fill && fill);
+        // a closure capturing nothing
+        static SExpr lambda(cow<LambdaCode> code);
+
+        // calls vis with the held value , a const lvalue
+        template<class R = void , class V>
+        R match(V && vis) const;
+
+        bool operator ==(const SExpr & rhs) const noexcept;
+
+        // whether its Object was allocated in a , immediates never are
+        bool allocated_in(const arena & a) const noexcept { return is_object() && a.owns(object()); }
+
+    private:
+        static constexpr uintptr_t tag_mask    = 0b111;
+        static constexpr uintptr_t boolean_tag = 0b010;
+        static constexpr uintptr_t symbol_tag  = 0b100;
+        static constexpr uintptr_t false_bits  = boolean_tag;
+        static constexpr uintptr_t true_bits   = boolean_tag | 0b1000;
+        static constexpr Integer min_fixnum = std::numeric_limits<Integer>::min() / 2;
+        static constexpr Integer max_fixnum = std::numeric_limits<Integer>::max() / 2;
+
+        static constexpr uintptr_t fixnum_bits(Integer i) noexcept {
+            return (static_cast<uintptr_t>(i) << 1) | 1;
+        }
+        static uintptr_t from_integer(Integer i) {
+            return min_fixnum <= i && i <= max_fixnum ? fixnum_bits(i) : address(allocate<Integer>(i));
+        }
+        static uintptr_t address(const Object * o) noexcept { return reinterpret_cast<uintptr_t>(o); }
+
+        template<class T , class ...Args>
+        static const Object * allocate(Args && ...args) { return allocate_units<T>(1 , std::forward<Args>(args)...); }
+        // units is the size of the Object in Boxed<T> , more than one for what is stored after the value
+        template<class T , class ...Args>
+        static const Object * allocate_units(std::size_t units , Args && ...args);
+        // destroys and frees an Object whose count dropped to zero , see reclaim .
+        // only destroys it with LISPY_GC , its region is the collector's
+        static void destroy(const Object * o) noexcept;
+        friend class gc::tracer;
+        friend class gc::heap;
+
+        bool is_object() const noexcept { return (_bits & tag_mask) == 0; }
+        const Object * object() const noexcept { return reinterpret_cast<const Object *>(_bits); }
+        template<class T>
+        const T & boxed() const noexcept { return static_cast<const Boxed<T> *>(object())->value; }
+
+#ifdef LISPY_GC
+        // the collector finds what is no longer reachable , copies count nothing
+        void retain() const noexcept {}
+        void release() noexcept {}
+#else
+        void retain() const noexcept {
+            if(is_object()) object()->count.add_ref();
+        }
+        void release() noexcept {
+            if(is_object() && object()->count.sub_ref() == 0) destroy(object());
+        }
+#endif
+
+    private:
+        uintptr_t _bits;
+    };
+
+    static_assert(sizeof(SExpr) == sizeof(void *));
+    // the low bits of their addresses are free for the tags
+    static_assert(alignof(std::string) >= 8);
+
+    // quoted value , compares by identity like the other shared alternatives
+    struct Quote{
+        SExpr value;
+
+        const SExpr & ref() const noexcept { return value; }
+        const SExpr & operator *() const noexcept { return value; }
+        const SExpr * operator ->() const noexcept { return &value; }
+
+        bool operator ==(const Quote & rhs) const noexcept { return this == &rhs; }
+    };
+
+    // proper list . elements are stored last to first , so lists sharing a tail share its storage :
+    // cdr is the same storage seen one element shorter , cons stores its car right after the tail
+    // if that allocated place is still free , otherwise copies the tail once into twice the room.
+    // stored elements never move nor change , whichever list stored them.
+    class List{
+        cow<vector<SExpr>> _cells;
+        std::size_t _size;
+
+        List(cow<vector<SExpr>> cells , std::size_t size) noexcept;
+        // marks all the stored elements , those of the lists sharing them included
+        friend class gc::tracer;
+    public:
+        using iterator = std::reverse_iterator<const SExpr *>;
+        using const_iterator = iterator;
+
+        // elements first to last.
+        // a template , so asking whether a List converts from something does not
+        // instantiate vector<SExpr> while SExpr is still incomplete
+        template<class Elements>
+        requires std::same_as<std::remove_cvref_t<Elements> , vector<SExpr>>
+        List(Elements && elements);
+
+        std::size_t size() const noexcept { return _size; }
+        // whether the storage of its elements , shared with other lists , was allocated in a
+        bool stored_in(const arena & a) const noexcept { return a.owns(&*_cells); }
+        bool empty() const noexcept { return _size == 0; }
+        iterator begin() const noexcept;
+        iterator end() const noexcept;
+        const SExpr & operator[](std::size_t i) const noexcept;
+
+        // lists are immutable , these read like the other cow wrapped alternatives
+        const List & ref() const noexcept { return *this; }
+        const List & operator *() const noexcept { return *this; }
+        const List * operator ->() const noexcept { return this; }
+
+        List cdr() const noexcept;
+        static List cons(SExpr car , const List & tail);
+
+        // the same list , not an equal one
+        bool operator ==(const List & rhs) const noexcept;
+    };
+
+    // what the closures of one lambda share , immutable but for compiled
+    struct LambdaCode{
+        short_vector<Symbol> var_names;
+        // where each closure takes its captured values from in the call creating it , LocalRef / CaptureRef
+        short_vector<SExpr> captures;
+        SExpr body;
+        // bytecode of body , made by the compiler , or by the vm when it first calls a tree-walker closure
+        mutable std::shared_ptr<const vm::Function> compiled{};
+    };
+
+    // closure , a single Object : its captured values and bound arguments are stored right after it ,
+    // so it is only ever built by SExpr::lambda and never copied.
     struct Lambda {
-        cexpr::cow<cexpr::vector<SExpr>> bounded;
-        cexpr::cow<cexpr::vector<std::string_view>> var_names;
-        cexpr::cow<cexpr::vector<std::pair<std::string_view,SExpr>>> free_vars;
-        cexpr::cow<SExpr>   body;
-        bool operator ==(const Lambda &) const = default;
+        cow<LambdaCode> code;
+        uint32_t n_captures;
+        uint32_t n_bounded;
+
+        Lambda(cow<LambdaCode> c , std::size_t captures , std::size_t bounded) noexcept
+        : code(std::move(c)) , n_captures(captures) , n_bounded(bounded) {
+            std::uninitialized_default_construct_n(slots() , n_captures + n_bounded);
+        }
+        Lambda(const Lambda &) = delete;
+        Lambda & operator =(const Lambda &) = delete;
+        ~Lambda() { std::destroy_n(slots() , n_captures + n_bounded); }
+
+        std::span<const SExpr> captures() const noexcept { return {slots() , n_captures}; }
+        std::span<const SExpr> bounded() const noexcept { return {slots() + n_captures , n_bounded}; }
+        // captures then bound arguments
+        std::span<const SExpr> values() const noexcept { return {slots() , n_captures + n_bounded}; }
+        // arguments a full application still takes
+        std::size_t expected() const noexcept { return code->var_names.size() - n_bounded; }
+
+        // closures compare by identity
+        bool operator ==(const Lambda & rhs) const noexcept { return this == &rhs; }
+
+    private:
+        friend struct SExpr;
+        SExpr * slots() const noexcept { return const_cast<SExpr *>(reinterpret_cast<const SExpr *>(this + 1)); }
     };
 
+    // params[0] is the called builtin , its arguments follow
+    using builtin_func = SExpr (*)(Closure & , List & params);
+
     struct BuiltinFn{
         std::string_view name;
+        builtin_func fn;
+        std::size_t arity;
         bool operator ==(const BuiltinFn &) const = default;
     };
-    using SExprBase = variant_base<Integer,Boolean,Symbol,Quote,List,Lambda,BuiltinFn>;
-    struct SExpr : SExprBase {
-        using SExprBase::variant_base;
-        bool operator ==(const SExpr & ) const = default;
+
+    // variable references of a lambda body , resolved when the lambda is created
+    struct LocalRef{
+        std::size_t slot;       // argument of the running call
+        Symbol name;
+        bool operator ==(const LocalRef &) const = default;
     };
 
+    struct CaptureRef{
+        std::size_t index;      // in free_vars of the running closure
+        Symbol name;
+        bool operator ==(const CaptureRef &) const = default;
+    };
+
+    struct GlobalRef{
+        std::size_t slot;       // see Environment::slot
+        Symbol name;
+        bool operator ==(const GlobalRef &) const = default;
+    };
+
+    // resolved (lambda ...) nested in a lambda body ,
+    // its closures capture the values of code->captures from the running call
+    struct LambdaForm{
+        cow<LambdaCode> code;
+        bool operator ==(const LambdaForm &) const = default;
+    };
+
+    // Boxed<Lambda> followed by n values
+    inline std::size_t lambda_units(std::size_t n) noexcept {
+        static_assert(sizeof(Boxed<Lambda>) == sizeof(Object) + sizeof(Lambda));
+        return 1 + (n * sizeof(SExpr) + sizeof(Boxed<Lambda>) - 1) / sizeof(Boxed<Lambda>);
+    }
+
+    template<class T , class ...Args>
+    const Object * SExpr::allocate_units(std::size_t units , Args && ...args){
+        static_assert(alignof(Boxed<T>) >= 8);
+#ifdef LISPY_GC
+        auto bytes = units * sizeof(Boxed<T>);
+        auto p = static_cast<Boxed<T> *>(gc::allocate(bytes));
+        try{
+            std::construct_at(p , std::forward<Args>(args)...);
+        }catch(...){
+            // left as a hole of booleans , which are never boxed , so a sweep skips it
+            std::construct_at(reinterpret_cast<Object *>(p) , Object{.size = static_cast<uint32_t>(bytes) , .type = kind::boolean});
+            throw;
+        }
+        p->size = static_cast<uint32_t>(bytes);
+#else
+        arena_allocator<Boxed<T>> alloc{};
+        auto p = alloc.allocate(units);
+        try{
+            std::construct_at(p , std::forward<Args>(args)...);
+        }catch(...){
+            alloc.deallocate(p , units);
+            throw;
+        }
+#endif
+        CEXPR_COUNT(cow_allocs);
+        return p;
+    }
+
+    template<class Fill>
+    SExpr SExpr::lambda(cow<LambdaCode> code , std::size_t n_captures , std::size_t n_bounded , Fill && fill){
+        auto n = n_captures + n_bounded;
+        SExpr e{};
+        e._bits = address(allocate_units<Lambda>(lambda_units(n) , std::move(code) , n_captures , n_bounded));
+        fill(std::span<SExpr>{e.boxed<Lambda>().slots() , n});
+        return e;
+    }
+
+    inline SExpr SExpr::lambda(cow<LambdaCode> code){
+        return lambda(std::move(code) , 0 , 0 , [](std::span<SExpr>){});
+    }
+
+    // lambda with args bound after its bound arguments , moved from them
+    template<std::ranges::sized_range Args>
+    SExpr curry(const Lambda & lambda , Args && args){
+        return SExpr::lambda(lambda.code , lambda.n_captures , lambda.n_bounded + std::ranges::size(args) ,
+            [&](std::span<SExpr> slots){
+                auto out = std::ranges::copy(lambda.values() , slots.begin()).out;
+                std::ranges::move(args , out);
+            });
+    }
+
+    template<class R , class V>
+    R SExpr::match(V && vis) const {
+        auto call = [&](const auto & value) -> R {
+            if constexpr (std::is_void_v<R>) std::invoke(vis , value);
+            else return std::invoke(vis , value);
+        };
+        switch(type()){
+        case kind::integer     : { const auto i = get<Integer>(); return call(i); }
+        case kind::boolean     : { const auto b = get<Boolean>(); return call(b); }
+        case kind::symbol      : { const auto s = get<Symbol>(); return call(s); }
+        case kind::quote       : return call(boxed<Quote>());
+        case kind::list        : return call(boxed<List>());
+        case kind::lambda      : return call(boxed<Lambda>());
+        case kind::builtin     : return call(boxed<BuiltinFn>());
+        case kind::local_ref   : return call(boxed<LocalRef>());
+        case kind::capture_ref : return call(boxed<CaptureRef>());
+        case kind::global_ref  : return call(boxed<GlobalRef>());
+        case kind::lambda_form : return call(boxed<LambdaForm>());
+        }
+        __builtin_unreachable();
+    }
+
+    inline bool SExpr::operator ==(const SExpr & rhs) const noexcept {
+        if(_bits == rhs._bits) return true;
+        // immediates are equal only bit for bit
+        if(!is_object() || !rhs.is_object() || object()->type != rhs.object()->type) return false;
+        return match<bool>([&](const auto & value){
+            return value == rhs.get<std::remove_cvref_t<decltype(value)>>();
+        });
+    }
+
+    inline List::List(cow<vector<SExpr>> cells , std::size_t size) noexcept
+    : _cells(std::move(cells)) , _size(size) {}
+
+    // each element moves once , straight into the new storage
+    template<class Elements>
+    requires std::same_as<std::remove_cvref_t<Elements> , vector<SExpr>>
+    List::List(Elements && elements)
+    : _cells(std::in_place) , _size(elements.size()) {
+        auto & cells = _cells.mut();
+        cells.reserve(_size);
+        for(auto i = _size ; i-- > 0 ; ){
+            if constexpr (std::is_const_v<std::remove_reference_t<Elements>> || std::is_lvalue_reference_v<Elements>)
+                cells.emplace_back(elements[i]);
+            else
+                cells.emplace_back(std::move(elements[i]));
+        }
+    }
+
+    inline List::iterator List::begin() const noexcept { return iterator{_cells->begin() + _size}; }
+    inline List::iterator List::end() const noexcept { return iterator{_cells->begin()}; }
+
+    inline const SExpr & List::operator[](std::size_t i) const noexcept {
+        return (*_cells)[_size - 1 - i];
+    }
+
+    inline bool List::operator ==(const List & rhs) const noexcept {
+        return _cells == rhs._cells && _size == rhs._size;
+    }
+
+    inline List List::cdr() const noexcept {
+        return List{_cells , _size - 1};
+    }
+
+    inline List List::cons(SExpr car , const List & tail){
+        auto & cells = *tail._cells;
+        if(tail._size == cells.size() && cells.size() < cells.capacity() && may_hold_temporaries(&cells)){
+            // no list stored anything after the tail yet , and storing there moves nothing
+            const_cast<vector<SExpr> &>(cells).push_back(std::move(car));
+            return List{tail._cells , tail._size + 1};
+        }
+        vector<SExpr> copy{};
+        copy.reserve(std::max<std::size_t>(4 , 2 * tail._size));
+        for(std::size_t i = 0 ; i < tail._size ; ++i) copy.push_back(cells[i]);
+        copy.push_back(std::move(car));
+        return List{std::move(copy) , tail._size + 1};
+    }
+
+    // dropping the last reference to a value destroys what it holds in a loop , not recursively .
+    // a drop frees at most free_slice objects , the others wait for the next drop or reclaim :
+    // the slice bounds the time one drop takes , it is unbounded by default.
+    // frees up to budget waiting objects , returns how many still wait
+    std::size_t reclaim(std::size_t budget = std::numeric_limits<std::size_t>::max()) noexcept;
+    std::size_t free_slice() noexcept;
+    // at least one , objects left waiting must be reclaimed before the arena they came from is released
+    void set_free_slice(std::size_t n) noexcept;
+
     std::optional<ast::SExpr> parse(std::string_view ) ;
+    // the same grammar written with the pscpp combinators , what parse must agree with
+    std::optional<ast::SExpr> parse_combinators(std::string_view ) ;
 
     std::string print_sexpr(const ast::SExpr &) ;
 
@@ -46,4 +584,9 @@ namespace ast{
 
 }
 
+template<>
+struct std::hash<lispy::ast::Symbol>{
+    std::size_t operator()(const lispy::ast::Symbol & s) const noexcept { return s.hash(); }
+};
+
 
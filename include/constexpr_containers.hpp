@@ -5,12 +5,35 @@
 #include <new>
 #include <version>
 #include <atomic>
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <utility>
 
 namespace cexpr{
 
-template<class T>
+// allocation counters of the containers below , only counted when CEXPR_STATS is defined
+struct stats{
+    std::size_t cow_allocs{0};      // blocks allocated by cow
+    std::size_t cow_clones{0};      // shared blocks deep copied by into_owned / mut
+    std::size_t vector_grows{0};    // reallocations of a vector's storage
+};
+
+#ifdef CEXPR_STATS
+inline stats counters{};
+#define CEXPR_COUNT(field) do{ if(!std::is_constant_evaluated()) ++::cexpr::counters.field; }while(0)
+#else
+#define CEXPR_COUNT(field) do{}while(0)
+#endif
+
+// Alloc is rebound to what each container actually allocates ,
+// std::allocator keeps them usable in constant expressions.
+template<class Alloc , class T>
+using rebind_t = typename std::allocator_traits<Alloc>::template rebind_alloc<T>;
+
+template<class T , class Alloc = std::allocator<T>>
 requires (!std::is_reference_v<T> && !std::is_void_v<T>)
-class box : protected std::allocator<T>{
+class box : protected rebind_t<Alloc , T>{
 public:
     using element_type = T;
 public:
@@ -59,57 +82,119 @@ private:
     T * _ptr{nullptr};
 };
 
-struct ref_count_safe_t{
-    mutable std::atomic<uint32_t> ref_cnt{1};
-    auto add_ref() const {
-        return ref_cnt.fetch_add(1 ,std::memory_order_relaxed);
-    }
-    auto sub_ref() const {
-        return ref_cnt.fetch_sub(1 , std::memory_order_acq_rel);
-    }
-    auto cnt() const {
-        return ref_cnt.load(std::memory_order_relaxed);
-    }
-};
+// counting policies of cow . add_ref and sub_ref return the new count ,
+// all of them count plainly in constant evaluation.
 
+// plain count , for blocks that never leave one thread
 struct ref_count_t{
     mutable uint32_t ref_cnt{1};
     constexpr auto cnt()    const {return ref_cnt;}
     constexpr auto add_ref() const { return ++ref_cnt;}
     constexpr auto sub_ref() const { return --ref_cnt;}
-    auto &safe() const { return reinterpret_cast<const ref_count_safe_t&>(*this);}
 };
 
-template<bool thread_safe , class T>
+// atomic count , always
+struct ref_count_safe_t{
+    alignas(std::atomic_ref<uint32_t>::required_alignment) mutable uint32_t ref_cnt{1};
+    constexpr auto cnt() const {
+        if(std::is_constant_evaluated()) return ref_cnt;
+        return std::atomic_ref{ref_cnt}.load(std::memory_order_relaxed);
+    }
+    constexpr auto add_ref() const {
+        if(std::is_constant_evaluated()) return ++ref_cnt;
+        return std::atomic_ref{ref_cnt}.fetch_add(1 , std::memory_order_relaxed) + 1;
+    }
+    constexpr auto sub_ref() const {
+        if(std::is_constant_evaluated()) return --ref_cnt;
+        return std::atomic_ref{ref_cnt}.fetch_sub(1 , std::memory_order_acq_rel) - 1;
+    }
+};
+
+namespace detail{
+    inline std::atomic<bool> shared_counts{false};
+}
+
+// turns every biased count atomic , for good.
+// call it before starting the threads that values are handed to ,
+// starting them then publishes the plain counts written so far.
+inline void share_across_threads() noexcept{
+    detail::shared_counts.store(true , std::memory_order_release);
+}
+
+inline bool counts_shared() noexcept{
+    return detail::shared_counts.load(std::memory_order_relaxed);
+}
+
+// counts atomic while alive , as share_across_threads , then plain again unless they were shared before.
+// the threads it was for must be joined first , tests use it to leave the plain counts to the others
+class sharing_scope{
+    bool _was{counts_shared()};
+public:
+    sharing_scope() noexcept { share_across_threads(); }
+    sharing_scope(const sharing_scope &) = delete;
+    sharing_scope & operator=(const sharing_scope &) = delete;
+    ~sharing_scope() { detail::shared_counts.store(_was , std::memory_order_release); }
+};
+
+// count biased to the single threaded case : plain while only one thread handles values ,
+// atomic once share_across_threads was called.
+struct ref_count_biased_t : ref_count_safe_t{
+    constexpr auto cnt() const {
+        if(std::is_constant_evaluated() || !counts_shared()) return ref_cnt;
+        return ref_count_safe_t::cnt();
+    }
+    constexpr auto add_ref() const {
+        if(std::is_constant_evaluated() || !counts_shared()) return ++ref_cnt;
+        return ref_count_safe_t::add_ref();
+    }
+    constexpr auto sub_ref() const {
+        if(std::is_constant_evaluated() || !counts_shared()) return --ref_cnt;
+        return ref_count_safe_t::sub_ref();
+    }
+};
+
+template<class Count , class T>
 struct ref_count_storage {
-    using ref_count = std::conditional_t<thread_safe , ref_count_safe_t , ref_count_t>;
     T data;
-    ref_count count{};
+    Count count{};
 
     constexpr ref_count_storage(T &&dt) noexcept
     : data(std::move(dt)) {}
 
     constexpr ref_count_storage(const T & dt) 
     : data(dt) {}
+
+    template<class ...Args>
+    constexpr ref_count_storage(std::in_place_t , Args && ...args)
+    : data(std::forward<Args>(args)...) {}
 };
 
-//default immutable and copy on write , 
-//thread safe atomic ref cnt at runtime
-template<class T>
+//default immutable and copy on write ,
+//counted by Count , see ref_count_biased_t
+template<class T , class Alloc = std::allocator<T> , class Count = ref_count_biased_t>
 requires (!std::is_reference_v<T> && !std::is_void_v<T>)
-class cow : protected std::allocator<ref_count_storage<false , T>>{
-    using block_t = ref_count_storage<false , T>;
+class cow : protected rebind_t<Alloc , ref_count_storage<Count , T>>{
+    using block_t = ref_count_storage<Count , T>;
 public:
     using value_type = T;
 public:
     constexpr cow() :_ptr(this->allocate(1)){
         static_assert(std::is_default_constructible_v<T>);
+        CEXPR_COUNT(cow_allocs);
         std::construct_at(_ptr, T{});
     }
 
     constexpr cow(T t) : _ptr(this->allocate(1)){
+        CEXPR_COUNT(cow_allocs);
         std::construct_at(_ptr , std::move(t));
     }
+    // T built right in the shared block , for values that are costly to move
+    template<class ...Args>
+    requires std::constructible_from<T , Args...>
+    constexpr explicit cow(std::in_place_t , Args && ...args) : _ptr(this->allocate(1)){
+        CEXPR_COUNT(cow_allocs);
+        std::construct_at(_ptr , std::in_place , std::forward<Args>(args)...);
+    }
     constexpr ~cow() noexcept {
         if(!_ptr || sub_ref() != 0) return ;
         std::destroy_at(_ptr);
@@ -147,6 +232,8 @@ public:
 public:
     constexpr T & into_owned() {
         if(cnt() == 1) return _ptr->data;
+        CEXPR_COUNT(cow_allocs);
+        CEXPR_COUNT(cow_clones);
         block_t * new_ptr = this->allocate(1);
         std::construct_at(new_ptr , _ptr->data);
         this->~cow();
@@ -163,16 +250,14 @@ public:
         return into_owned();
     }
     constexpr auto cnt() const {
-        return std::is_constant_evaluated() ? _ptr->count.cnt() : _ptr->count.safe().cnt();
+        return _ptr->count.cnt();
     }
 private:
     constexpr auto sub_ref() const {
-        if(std::is_constant_evaluated()) return _ptr->count.sub_ref();
-        else return _ptr->count.safe().sub_ref();
+        return _ptr->count.sub_ref();
     }
     constexpr auto add_ref() const {
-        if(std::is_constant_evaluated()) return _ptr->count.add_ref();
-        else return _ptr->count.safe().add_ref();
+        return _ptr->count.add_ref();
     }
 
 protected:
@@ -181,8 +266,8 @@ protected:
 
 //simple vector support constexpr , 
 //cause constexpr std::vector is still unsupported.
-template<class T>
-class vector : private std::allocator<T>{
+template<class T , class Alloc = std::allocator<T>>
+class vector : private rebind_t<Alloc , T>{
 public:
     constexpr vector()  = default;
     constexpr vector(const std::initializer_list<T> & ls) {
@@ -220,7 +305,7 @@ public:
 
     constexpr vector & operator = (vector && v) noexcept{
         if(std::addressof(v) == this) return *this;
-        if(_start)deconstruct_all();
+        this->~vector();
         move_values_from(v);
         return *this;
     }
@@ -232,6 +317,7 @@ public:
     constexpr std::size_t size() const { return _n;}
     constexpr std::size_t capacity() const {return _n_storage;}
     constexpr bool empty() const {return _n == 0;}
+    constexpr void reserve(std::size_t n) { preserve(n); }
 
     constexpr iterator begin(){return _start;}
     constexpr iterator end(){return _start+_n;}
@@ -279,9 +365,11 @@ private:
             _n_storage = n;
         }
         else if( capacity() < n){
+            CEXPR_COUNT(vector_grows);
             T* p = this->allocate(n);
             if(p == nullptr)  throw std::bad_alloc{};
             uninitialize_move_all(p , *this);
+            std::destroy_n(_start , size());
             this->deallocate(_start , _n_storage);
             _n_storage = n;
             _start = p;
@@ -328,4 +416,152 @@ private:
     T * _start{nullptr};
 };
 
+//vector keeping up to N elements inside itself , it allocates only beyond that.
+//constant evaluation cannot reuse raw storage as objects , so there every element is allocated.
+template<class T , std::size_t N , class Alloc = std::allocator<T>>
+requires (N > 0)
+class small_vector : private rebind_t<Alloc , T>{
+public:
+    constexpr small_vector() noexcept{
+        if(!std::is_constant_evaluated()) use_inline();
+    }
+
+    constexpr small_vector(std::initializer_list<T> ls) : small_vector(){
+        reserve(ls.size());
+        for(auto & x : ls) std::construct_at(_start + _n++ , x);
+    }
+
+    constexpr small_vector(const small_vector & v) : small_vector(){
+        reserve(v.size());
+        for(auto & x : v) std::construct_at(_start + _n++ , x);
+    }
+
+    constexpr small_vector(small_vector && v) noexcept : small_vector(){
+        take(v);
+    }
+
+    constexpr ~small_vector() noexcept{
+        clear();
+        deallocate_storage();
+    }
+
+    constexpr small_vector & operator = (const small_vector & v){
+        if(std::addressof(v) == this) return *this;
+        clear();
+        reserve(v.size());
+        for(auto & x : v) std::construct_at(_start + _n++ , x);
+        return *this;
+    }
+
+    constexpr small_vector & operator = (small_vector && v) noexcept{
+        if(std::addressof(v) == this) return *this;
+        clear();
+        deallocate_storage();
+        if(!std::is_constant_evaluated()) use_inline();
+        take(v);
+        return *this;
+    }
+
+public:
+    using value_type = T;
+    using iterator = T *;
+    using const_iterator = const T *;
+    static constexpr std::size_t inline_capacity = N;
+
+public:
+    constexpr std::size_t size() const { return _n;}
+    constexpr std::size_t capacity() const {return _cap;}
+    constexpr bool empty() const {return _n == 0;}
+
+    constexpr iterator begin(){return _start;}
+    constexpr iterator end(){return _start + _n;}
+    constexpr const_iterator begin() const {return _start;}
+    constexpr const_iterator end() const {return _start + _n;}
+
+    constexpr T & operator[] (std::size_t i){ return _start[i]; }
+    constexpr const T & operator [](std::size_t i) const{ return _start[i]; }
+
+    constexpr void reserve(std::size_t n){
+        if(n <= _cap) return;
+        // leaving the inline storage is a first allocation , as for an empty vector
+        if(!std::is_constant_evaluated() && !is_inline()) CEXPR_COUNT(vector_grows);
+        T * p = this->allocate(n);
+        for(std::size_t i = 0 ; i < _n ; ++i){
+            std::construct_at(p + i , std::move(_start[i]));
+            std::destroy_at(_start + i);
+        }
+        deallocate_storage();
+        _start = p;
+        _cap = n;
+    }
+
+    constexpr void push_back(T t){
+        emplace_back(std::move(t));
+    }
+
+    template<class ...TArgs>
+    requires std::constructible_from<T , TArgs...>
+    constexpr void emplace_back(TArgs && ...args) {
+        if(_n == _cap){
+            // constructed first , args may refer to an element
+            T t(std::forward<TArgs>(args)...);
+            reserve(_n ? 2 * _n : std::max<std::size_t>(N , 1));
+            std::construct_at(_start + _n , std::move(t));
+        }else{
+            std::construct_at(_start + _n , std::forward<TArgs>(args)...);
+        }
+        ++_n;
+    }
+
+    constexpr void clear() noexcept{
+        std::destroy_n(_start , _n);
+        _n = 0;
+    }
+
+    constexpr bool operator== (const small_vector & v) const{
+        if(size() != v.size()) return false;
+        for(std::size_t i = 0 ; i < _n ; ++i)
+            if(!(_start[i] == v[i])) return false;
+        return true;
+    }
+
+private:
+    T * inline_data() noexcept { return std::launder(reinterpret_cast<T *>(_inline)); }
+    bool is_inline() const noexcept { return _start == reinterpret_cast<const T *>(_inline); }
+
+    void use_inline() noexcept{
+        _start = inline_data();
+        _cap = N;
+    }
+
+    constexpr void deallocate_storage() noexcept{
+        if(!_start) return;
+        if(std::is_constant_evaluated() || !is_inline()) this->deallocate(_start , _cap);
+        _start = nullptr;
+        _cap = 0;
+    }
+
+    // v is left empty , with its own storage
+    constexpr void take(small_vector & v) noexcept{
+        if(std::is_constant_evaluated() || !v.is_inline()){
+            deallocate_storage();
+            _start = std::exchange(v._start , nullptr);
+            _cap = std::exchange(v._cap , 0);
+            _n = std::exchange(v._n , 0);
+            if(!std::is_constant_evaluated()) v.use_inline();
+            return;
+        }
+        // both are inline , N is at least what v holds
+        for(std::size_t i = 0 ; i < v._n ; ++i) std::construct_at(_start + i , std::move(v._start[i]));
+        _n = v._n;
+        v.clear();
+    }
+
+private:
+    alignas(T) std::byte _inline[N * sizeof(T)];
+    T * _start{nullptr};
+    std::size_t _n{0};
+    std::size_t _cap{0};
+};
+
 };
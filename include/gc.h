@@ -0,0 +1,130 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <unordered_set>
+#include <vector>
+
+#include "ast.h"
+
+namespace lispy{
+
+// optional tracing collector , LISPY_GC builds ( make GC=1 ) use it in place of the refcounts of SExpr objects.
+// objects are bump allocated in fixed size regions and never move , so references into them stay valid .
+// a collection marks what the roots reach , destroys the rest in place and reuses the regions left empty.
+// it only runs at safe points , where every live value is reachable from a root :
+// the end of Runtime::eval , and calls of a vm run started by it ( see vm::Machine::run ).
+namespace gc{
+
+    // marks reachable objects , without recursion , so long lists and deep closures do not overflow
+    class tracer{
+    public:
+        void mark(const ast::SExpr & e);
+        void mark(const vm::Function & fn);
+        void mark(const ast::LambdaCode & code);
+
+    private:
+        friend class heap;
+        void drain();
+
+        std::vector<const ast::Object *> _pending{};
+        // code is refcounted , shared and acyclic , it is traced once per collection
+        std::unordered_set<const void *> _traced{};
+    };
+
+    using roots = std::function<void(tracer &)>;
+
+    struct heap_stats{
+        std::size_t collections{0};
+        std::size_t regions{0};         // allocated , empty ones included
+        std::size_t live_bytes{0};      // what the last collection kept
+        std::size_t allocated{0};       // since the last collection
+    };
+
+    class heap{
+    public:
+        // regions of larger objects are sized for them alone
+        static constexpr std::size_t region_size = 256 * 1024;
+        // a collection is due once this much , or the live size if larger , was allocated since the last one
+        static constexpr std::size_t min_threshold = 8 * 1024 * 1024;
+
+        static heap & instance() {
+            static heap h{};   return h;
+        }
+
+        heap(const heap &) = delete;
+        heap & operator=(const heap &) = delete;
+        ~heap();
+
+        void * allocate(std::size_t bytes);
+        bool should_collect() const noexcept { return _allocated >= _threshold; }
+        void collect(const roots & r);
+        heap_stats stats() const noexcept;
+
+    private:
+        heap() = default;
+
+        struct region{
+            std::byte * begin;
+            std::byte * top;
+            std::byte * end;
+        };
+        bool refill(std::size_t bytes);
+        // destroys the unmarked objects of r , false when none was marked
+        static bool sweep(region & r) noexcept;
+
+    private:
+        std::vector<region> _regions{};
+        std::vector<region> _empty{};
+        region * _current{nullptr};
+        std::size_t _allocated{0};
+        std::size_t _threshold{min_threshold};
+        std::size_t _live{0};
+        std::size_t _collections{0};
+    };
+
+#ifdef LISPY_GC
+    inline bool should_collect() noexcept { return heap::instance().should_collect(); }
+#endif
+
+    // keeps a value held outside the interpreter alive across collections ,
+    // a plain holder without LISPY_GC
+    class root{
+    public:
+        explicit root(ast::SExpr value);
+        root(const root &) = delete;
+        root & operator=(const root &) = delete;
+        ~root();
+
+        const ast::SExpr & get() const noexcept { return _value; }
+        const ast::SExpr & operator *() const noexcept { return _value; }
+
+        // marks every live root
+        static void trace(tracer & t);
+
+    private:
+        ast::SExpr _value;
+#ifdef LISPY_GC
+        root * _prev{nullptr};
+        root * _next{nullptr};
+        static inline root * _first{nullptr};
+#endif
+    };
+
+#ifdef LISPY_GC
+    inline root::root(ast::SExpr value) : _value(std::move(value)) , _next(_first) {
+        if(_first) _first->_prev = this;
+        _first = this;
+    }
+    inline root::~root() {
+        if(_prev) _prev->_next = _next;
+        else _first = _next;
+        if(_next) _next->_prev = _prev;
+    }
+#else
+    inline root::root(ast::SExpr value) : _value(std::move(value)) {}
+    inline root::~root() = default;
+#endif
+
+}
+
+}
@@ -4,198 +4,254 @@
 
 #include "types.h"
 
-//basic monadic definition 
+//basic monadic definition
+
+//every combinator returns a parser of its own static type , calling it calls its parts directly .
+//parser_t erases the type only where a grammar refers to itself , see chainr1 .
 
 //monad
 //a -> parser a
 template<class T>
-parseable auto result(T && t) {
+constexpr parseable auto result(T && t) {
     return [t = std::forward<T>(t)]
-    (parser_string str)->parser_result<std::remove_reference_t<T>>{
+    (parser_string str)->parser_result<std::remove_cvref_t<T>>{
         return std::pair{t , str};
     };
 }
 //parser a -> (a->parser b) -> parser b
 template<parseable P , bindable<P> F>
-parseable auto bind(P && p , F && f) {
+constexpr parseable auto bind(P && p , F && f) {
     using T1 = typename parser_traits<P>::type;                             //a
     using T2 = typename parser_traits<std::invoke_result_t<F , T1>>::type;   //b
-    auto ret_p = [=]
+    return [p = std::forward<P>(p) , f = std::forward<F>(f)]
     (parser_string str)->parser_result<T2>{
         auto r1 = p(str);
         if(!r1) return {};
         else return f(std::move(r1->first))(r1->second);
     };
-    return parser_t<T2>(std::move(ret_p));
 }
 
 //monad plus
 //parser a
 template<class T>
-auto zero (parser_string str) -> parser_result<T>{
+constexpr auto zero (parser_string str) -> parser_result<T>{
     return {} ;
 }
 //parser a -> parser a -> parser a
 template<parseable P1 , parseable P2>
 requires same_parser<P1 ,P2>
-parseable auto plus(P1 && p1 , P2 && p2)  {
+constexpr parseable auto plus(P1 && p1 , P2 && p2)  {
     using T1 = typename parser_traits<P1>::type;
-    auto ret_p = [=](parser_string str)->parser_result<T1>{
+    return [p1 = std::forward<P1>(p1) , p2 = std::forward<P2>(p2)]
+    (parser_string str)->parser_result<T1>{
         if(auto r1 = p1(str); r1) return r1;
-        if(auto r2 = p2(str); r2) return r2;
-        return {};
+        return p2(str);
     };
-    return parser_t<T1>(std::move(ret_p));
 };
 
-//applicative 
+//applicative
 //lift : f -> parser f
 template<callable F>
-parseable auto lift(F && f) {
+constexpr parseable auto lift(F && f) {
     return result(make_curry(std::forward<F>(f)));
 }
 
 template<parseable F , parseable P>
 requires std::is_invocable_v<typename parser_traits<F>::type , typename parser_traits<P>::type>
-parseable auto apply(F && pf , P && p){
-    return bind( pf , [=](auto && f){
-        return bind(p , [f](auto && x){
-            return result(f(std::move(x)));
-        });
-    });
+constexpr parseable auto apply(F && pf , P && p){
+    using R = std::remove_cvref_t<std::invoke_result_t<typename parser_traits<F>::type , typename parser_traits<P>::type>>;
+    return [pf = std::forward<F>(pf) , p = std::forward<P>(p)]
+    (parser_string str)->parser_result<R>{
+        auto rf = pf(str);
+        if(!rf) return {};
+        auto rx = p(rf->second);
+        if(!rx) return {};
+        return std::pair{rf->first(std::move(rx->first)) , rx->second};
+    };
 }
 
 //functor
 template<callable F , parseable P>
-parseable auto fmap(F && f , P && p){
-    return bind(p , [f = make_curry(f)](auto && x){
-        return result( f(std::move(x)) );
-    });
+constexpr parseable auto fmap(F && f , P && p){
+    using curried = decltype(make_curry(std::forward<F>(f)));
+    using R = std::remove_cvref_t<std::invoke_result_t<const curried & , typename parser_traits<P>::type>>;
+    return [f = make_curry(std::forward<F>(f)) , p = std::forward<P>(p)]
+    (parser_string str)->parser_result<R>{
+        auto r = p(str);
+        if(!r) return {};
+        return std::pair{f(std::move(r->first)) , r->second};
+    };
 }
 
 //parser a -> parser b -> parser (a , b)
 template<parseable P1 , parseable P2>
-parseable auto seq(P1 && p1 , P2 && p2) {
+constexpr parseable auto seq(P1 && p1 , P2 && p2) {
     using T1 = typename parser_traits<P1>::type;
     using T2 = typename parser_traits<P2>::type;
     using Ret = decltype(product(std::declval<T1>() , std::declval<T2>()));
 
-    auto ret_p = [=](parser_string str)->parser_result<Ret>{
+    return [p1 = std::forward<P1>(p1) , p2 = std::forward<P2>(p2)]
+    (parser_string str)->parser_result<Ret>{
         if      (auto r1 = p1(str);!r1) return std::nullopt;
         else if (auto r2 = p2(r1->second);!r2) return std::nullopt;
-        else    return  std::pair{product(r1->first , r2->first) , r2->second};
+        else    return  std::pair{product(std::move(r1->first) , std::move(r2->first)) , r2->second};
     };
-    return parser_t<Ret>(std::move(ret_p));
 }
 
 //suger operator : >>= + | >> <<
 //note : >>= is right associative , we need to implement F1 'bind' F2 to satisfy associative law
 template<parseable P1 , bindable<P1> F>
-parseable auto operator >>= (P1 && p1 , F && f){
+constexpr parseable auto operator >>= (P1 && p1 , F && f){
     return bind(std::forward<P1>(p1) , std::forward<F>(f));
 }
 
 template<parseable P1 , parseable P2>
-parseable auto operator + (P1 && p1 , P2 && p2){
+constexpr parseable auto operator + (P1 && p1 , P2 && p2){
     return seq(std::forward<P1>(p1) , std::forward<P2>(p2));
 }
 
 template<parseable F , parseable P>
-parseable auto operator * (F && f , P && p ){
+constexpr parseable auto operator * (F && f , P && p ){
     return apply(std::forward<F>(f) , std::forward<P>(p));
 }
 
 template<parseable P1 , parseable P2>
 requires same_parser<P1 ,P2>
-parseable auto operator |(P1 && p1 , P2 && p2)  {
+constexpr parseable auto operator |(P1 && p1 , P2 && p2)  {
     return plus(std::forward<P1>(p1) , std::forward<P2>(p2));
 }
 
 template<parseable P1 , parseable P2>
-parseable auto operator >> (P1 && p1 , P2 && p2) {
-    return seq(std::forward<P1>(p1) , std::forward<P2>(p2)) 
-        >>= [](auto && tp){
-            auto && [_ , r] = tp;
-            return result(std::move(r));
-        };
+constexpr parseable auto operator >> (P1 && p1 , P2 && p2) {
+    using T2 = typename parser_traits<P2>::type;
+    return [p1 = std::forward<P1>(p1) , p2 = std::forward<P2>(p2)]
+    (parser_string str)->parser_result<T2>{
+        auto r1 = p1(str);
+        if(!r1) return {};
+        return p2(r1->second);
+    };
 }
 
 template<parseable P1 , parseable P2>
-parseable auto operator << (P1 && p1 , P2 && p2){
-    return seq(std::forward<P1>(p1) , std::forward<P2>(p2)) 
-            >>= [](auto && tp){
-                auto && [l , _] = tp;
-                return result(std::move(l));
-            };
+constexpr parseable auto operator << (P1 && p1 , P2 && p2){
+    using T1 = typename parser_traits<P1>::type;
+    return [p1 = std::forward<P1>(p1) , p2 = std::forward<P2>(p2)]
+    (parser_string str)->parser_result<T1>{
+        auto r1 = p1(str);
+        if(!r1) return {};
+        auto r2 = p2(r1->second);
+        if(!r2) return {};
+        return std::pair{std::move(r1->first) , r2->second};
+    };
 }
 
 //Repetition
 
+//parser a -> b -> (b -> a -> b) -> parser b
+//zero or more p , folded from the left into init as they are parsed
+template<parseable P , class T , class F>
+requires std::is_invocable_r_v<T , F , T && , typename parser_traits<P>::type>
+constexpr parseable auto foldl(P && p , T init , F && f){
+    return [p = std::forward<P>(p) , init = std::move(init) , f = std::forward<F>(f)]
+    (parser_string str)->parser_result<T>{
+        T acc = init;
+        while(auto r = p(str)){
+            acc = f(std::move(acc) , std::move(r->first));
+            str = r->second;
+        }
+        return std::pair{std::move(acc) , str};
+    };
+}
+
 //many1 , many
 template<parseable P>
-auto many(P && p) -> parser_t<std::forward_list<typename parser_traits<P>::type>>{
+constexpr parseable auto many(P && p){
     using data_type = typename parser_traits<P>::type;
     using list_type = std::forward_list<data_type>;
-
-    return plus(
-        p       >>= [=](data_type x)                     -> auto {return
-        many(p) >>= [x = std::move(x)](list_type && xs)  -> auto {return 
-            result((xs.push_front(std::move(x)) , std::move(xs)));
-        };},
-        result(list_type{})
-    );
-} 
+    return [p = std::forward<P>(p)]
+    (parser_string str)->parser_result<list_type>{
+        list_type xs{};
+        auto last = xs.before_begin();
+        while(auto r = p(str)){
+            last = xs.insert_after(last , std::move(r->first));
+            str = r->second;
+        }
+        return std::pair{std::move(xs) , str};
+    };
+}
 
 template<parseable P>
-parseable auto many1(P && p){
-    return (p + many(p)) >>= [](auto && tp){
-        auto && [x ,xs] = tp;
-        return result((xs.push_front(std::move(x)) , std::move(xs)));
+constexpr parseable auto many1(P && p){
+    using list_type = std::forward_list<typename parser_traits<P>::type>;
+    return [m = many(std::forward<P>(p))]
+    (parser_string str)->parser_result<list_type>{
+        auto r = m(str);
+        if(r->first.empty()) return {};
+        return r;
     };
 }
 
 //sepby1 , sepby
 //parser a -> parser b -> parser [a]
 template<parseable P , parseable Sep>
-parseable auto sepby1( P && p , Sep && sep) {
-    return (p + many(sep >> p)) 
-    >>= [](auto && tp){
-        auto && [x , xs] = tp;
-        return result((xs.push_front(std::move(x)) , std::move(xs)));
+constexpr parseable auto sepby1( P && p , Sep && sep) {
+    using list_type = std::forward_list<typename parser_traits<P>::type>;
+    return [p = std::forward<P>(p) , sep = std::forward<Sep>(sep)]
+    (parser_string str)->parser_result<list_type>{
+        auto r = p(str);
+        if(!r) return {};
+        list_type xs{std::move(r->first)};
+        str = r->second;
+        for(auto last = xs.begin() ; ; ){
+            auto s = sep(str);
+            if(!s) break;
+            r = p(s->second);
+            if(!r) break;
+            last = xs.insert_after(last , std::move(r->first));
+            str = r->second;
+        }
+        return std::pair{std::move(xs) , str};
     };
 }
 
 template<parseable P , parseable Sep>
-parseable auto sepby(P && p , Sep && sep){
-    using list_type = typename parser_traits<P>::type;
+constexpr parseable auto sepby(P && p , Sep && sep){
+    using list_type = std::forward_list<typename parser_traits<P>::type>;
     return sepby1(std::forward<P>(p) , std::forward<Sep>(sep)) | result(list_type{});
 }
 
 template<parseable Open , parseable P , parseable Close>
-parseable auto bracket( Open && open , P && p ,  Close && close){
+constexpr parseable auto bracket( Open && open , P && p ,  Close && close){
     return (open >> p << close) ;
 }
 
 //parser a -> parser (a -> a -> a) -> parser a
 template<parseable T , parseable Op>
-auto chainl1(T && p , Op && op) -> parser_t<typename parser_traits<T>::type> {
+constexpr parseable auto chainl1(T && p , Op && op) {
     using TA = typename parser_traits<T>::type ;
     using TOp= typename parser_traits<Op>::type;
 
     static_assert(std::is_invocable_v<TOp , TA , TA>);
 
-    return (p + many(op + p))
-        >>= [](auto && tp){
-            auto && [ x , fys ] = tp;
-            for(auto && fy : fys){
-                auto && [op , y] = fy;
-                x = op(x , y);
-            }
-            return result(x);
-        };
+    return [p = std::forward<T>(p) , op = std::forward<Op>(op)]
+    (parser_string str)->parser_result<TA>{
+        auto r = p(str);
+        if(!r) return {};
+        TA x = std::move(r->first);
+        str = r->second;
+        for(;;){
+            auto f = op(str);
+            if(!f) break;
+            auto y = p(f->second);
+            if(!y) break;
+            x = f->first(std::move(x) , std::move(y->first));
+            str = y->second;
+        }
+        return std::pair{std::move(x) , str};
+    };
 }
 
-//chainr1
+//chainr1 , the parser refers to itself , so it is erased as parser_t
 template<parseable T , parseable Op>
 auto chainr1(T && p , Op && op) -> parser_t<typename parser_traits<T>::type >{
     using TA = typename parser_traits<T>::type ;
@@ -217,13 +273,13 @@ auto chainr1(T && p , Op && op) -> parser_t<typename parser_traits<T>::type >{
 
 template<parseable T1 , parseable Op , parseable T2>
 requires same_parser<T1,T2>
-auto chainl(T1 && p , Op && op , T2 &&  v) -> parser_t<typename parser_traits<T1>::type >{
-    return chainl1(std::forward<T1>(p) , std::forward<Op>(op)) | result(std::forward<T2>(v));
+constexpr parseable auto chainl(T1 && p , Op && op , T2 &&  v) {
+    return chainl1(std::forward<T1>(p) , std::forward<Op>(op)) | std::forward<T2>(v);
 }
 //chainr
 
 template<parseable T1 , parseable Op , parseable T2>
 requires same_parser<T1,T2>
 auto chainr(T1 && p , Op && op , T2 &&  v) -> parser_t<typename parser_traits<T1>::type >{
-    return chainr1(std::forward<T1>(p) , std::forward<Op>(op)) | result(std::forward<T2>(v));
-}
\ No newline at end of file
+    return chainr1(std::forward<T1>(p) , std::forward<Op>(op)) | std::forward<T2>(v);
+}
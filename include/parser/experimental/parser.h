@@ -7,93 +7,86 @@
 #include "combinator.h"
 
 //parser char
-inline auto item (parser_string str) -> parser_result<char>{
+constexpr auto item (parser_string str) -> parser_result<char>{
     if(str.empty()) return {};
     else            return std::pair{str[0] , str.substr(1)};
 }
 
 // (char -> bool) -> parser char
 template<std::predicate<char> Pred>
-parseable auto satisfy(Pred && predicate) {
-    return item 
-    >>= [=](char x)-> parser_t<char>{
-        if (predicate(x)) return result(x);  
-        else return zero<char>;
+constexpr parseable auto satisfy(Pred && predicate) {
+    return [predicate = std::forward<Pred>(predicate)]
+    (parser_string str)->parser_result<char>{
+        if(!str.empty() && predicate(str[0])) return std::pair{str[0] , str.substr(1)};
+        else return {};
     };
 }
 
 // a -> a -> parser a
-inline parseable auto range(char l , char h){
+constexpr parseable auto range(char l , char h){
     return satisfy([=](char c){ return c >= l && c <= h;});
 }
 
 //[char] -> parser [char]
-inline parseable auto oneof(std::string_view chs){
+constexpr parseable auto oneof(std::string_view chs){
     return satisfy([=](char ch){ return chs.find(ch) != chs.npos;});
 }
 
 //char -> parser char
-inline parseable auto onechar(char ch){
+constexpr parseable auto onechar(char ch){
     return satisfy([=](char x)->bool{return x == ch;});
 }
 
 //string -> parser string
-inline auto string(std::string_view word) -> parser_t<std::string_view>{
-    using namespace std::literals;
-    if(word.empty()) return result(""sv);
-    else return 
-        (onechar(word[0]) + string(word.substr(1))) 
-        >>= [=](auto && _) {return result(word);};
+constexpr parseable auto string(std::string_view word){
+    return [=](parser_string str)->parser_result<std::string_view>{
+        if(str.starts_with(word)) return std::pair{word , str.substr(word.size())};
+        else return {};
+    };
 };
 
-inline parseable auto operator ""_char (char ch) {
+constexpr parseable auto operator ""_char (char ch) {
     return onechar(ch);
 }
 
-inline parseable auto operator ""_string(const char * word){
-    return string(word);
+constexpr parseable auto operator ""_string(const char * word , std::size_t size){
+    return string(std::string_view{word , size});
 }
 
-inline parser_t<char> digit = range('0' , '9');
+inline constexpr auto digit = range('0' , '9');
 
-inline parser_t<char> upper = range('A' , 'Z');
+inline constexpr auto upper = range('A' , 'Z');
 
-inline parser_t<char> lower = range('a' , 'z');
+inline constexpr auto lower = range('a' , 'z');
 
-inline parser_t<char> letter = upper | lower ;
+inline constexpr auto letter = upper | lower ;
 
-inline parser_t<char> alphanum = letter | digit ;
+inline constexpr auto alphanum = letter | digit ;
 
-inline parser_t<std::string> word = 
-    fix([](auto && word) -> parser_t<std::string>{
-        using namespace std::literals;
-        return plus(
-            ((letter + word) >>= [](const product_type<char , std::string> & tp){
-                auto &&[ch , xs] = tp.tp;
-                return result(ch + xs);
-            }) 
-            , result(std::string{})
-        );
-    });
+//letters appended in place , linear in the length of the word
+inline const auto word = foldl(letter , std::string{} , [](std::string && w , char ch){
+    w.push_back(ch);
+    return std::move(w);
+});
 
 
 template<std::integral T>
-inline parser_t<T> natural = lift(char_list_to_integer<int>) * many1(digit);
+inline const auto natural = lift(char_list_to_integer<T>) * many1(digit);
 
 template<std::integral T>
-inline parser_t<T> negative = lift(std::negate<T>{}) * ('-'_char >> natural<T>) ;
+inline const auto negative = lift(std::negate<T>{}) * ('-'_char >> natural<T>) ;
 
 template<std::integral T>
-inline parser_t<T> integer = natural<T> | negative<T> ;
+inline const auto integer = natural<T> | negative<T> ;
 
 //parser [int]
 template<std::integral T>
-inline auto ints = '['_char >> sepby1(integer<T> , ','_char ) << ']'_char;
+inline const auto ints = '['_char >> sepby1(integer<T> , ','_char ) << ']'_char;
 
-//Lexial 
+//Lexial
 
-inline auto newline = '\n'_char;
+inline constexpr auto newline = '\n'_char;
 
-inline auto is_space = ' '_char | '\n'_char | '\t'_char;
+inline constexpr auto is_space = ' '_char | '\n'_char | '\t'_char;
 
-inline auto spaces = many(is_space);
\ No newline at end of file
+inline constexpr auto spaces = many(is_space);
@@ -37,10 +37,7 @@ concept callable = requires (F f){
 };
 
 template<class F , class P>
-concept bindable = requires(F f , P p){
-    parseable<P>;
-    parseable<std::invoke_result_t<F ,typename parser_traits<P>::type>>;
-};
+concept bindable = parseable<P> && parseable<std::invoke_result_t<F ,typename parser_traits<P>::type>>;
 
 template<class T1 , class T2>
 concept same_parser = 
@@ -48,7 +45,7 @@ concept same_parser =
     parseable<T2> && 
     std::is_same_v<typename parser_traits<T1>::type ,typename parser_traits<T2>::type>;
 
-//concrete function type erase
+//concrete function type erase , for the parsers that refer to themselves
 template<class T>
 using parser_t = std::function<parser_result<T>(parser_string)>;
 
@@ -168,6 +165,6 @@ struct curry_t {
 };
 
 template<typename F>
-constexpr curry_t<F> make_curry(F&& f) {
+constexpr curry_t<std::decay_t<F>> make_curry(F&& f) {
     return { std::forward<F>(f) };
 }
\ No newline at end of file
@@ -10,7 +10,7 @@ namespace pscpp{
 //a -> parser a
 template<class T>
 constexpr auto result(T && t){
-    return [t= std::forward<T>(t)](parser_string str) -> parser_result<T>{
+    return [t= std::forward<T>(t)](parser_string str) -> parser_result<std::remove_cvref_t<T>>{
         return std::pair{t , str};
     };
 }
@@ -32,10 +32,10 @@ template<class F , Parser ...Ps>
 requires std::invocable<F , typename parser_traits<Ps>::type ...>
 constexpr auto fmap(F && f , Ps && ...ps) {
     using R = std::invoke_result_t<F , typename parser_traits<Ps>::type ...>;
-    return [=](parser_string str) -> parser_result<R> {
-        auto res = chain_parse(str , ps ...);
-        if(!res) return {};
-        return parser_result<R>{std::apply(f , std::move(res->first)) , res->second};
+    return [f = std::forward<F>(f) , ...ps = std::forward<Ps>(ps)](parser_string str) -> parser_result<R> {
+        return chain_apply<R>(str , [&](parser_string remain , auto && ...xs){
+            return parser_result<R>{std::invoke(f , std::forward<decltype(xs)>(xs)...) , remain};
+        } , ps...);
     };
 }
 
@@ -51,7 +51,7 @@ requires std::invocable<F , typename parser_traits<P>::type>
 constexpr Parser auto bind(P && p , F && f){
     using PT= std::invoke_result_t<F , typename parser_traits<P>::type>;
     using T = typename parser_traits<PT>::type;
-    return [=](parser_string str)->parser_result<T>{
+    return [p = std::forward<P>(p) , f = std::forward<F>(f)](parser_string str)->parser_result<T>{
         auto r1 = p(str);
         if(!r1) return {};
         else return f(std::move(r1->first))(r1->second);
@@ -63,10 +63,9 @@ template<Parser P1, Parser P2>
 requires std::is_same_v<typename parser_traits<P1>::type , typename parser_traits<P2>::type>
 constexpr Parser auto plus(P1 && p1 , P2 && p2){
     using R = typename parser_traits<P1>::type;
-    return [=](parser_string str)->parser_result<R>{
+    return [p1 = std::forward<P1>(p1) , p2 = std::forward<P2>(p2)](parser_string str)->parser_result<R>{
         if(auto r1 = p1(str) ; r1) return r1;
-        if(auto r2 = p2(str) ; r2) return r2;
-        return {};
+        return p2(str);
     };
 }
 
@@ -88,11 +87,10 @@ constexpr Parser auto operator |(P1 && p1 , P2 && p2)  {
 template<Parser P1 , Parser P2>
 constexpr Parser auto operator >> (P1 && p1 , P2 && p2 ){
     using R = typename parser_traits<P2>::type;
-    return [=](parser_string str) -> parser_result<R>{
-        auto result = chain_parse(str , p1 , p2);
-        if(!result) return {};
-        auto && [ _ , x] = result->first;
-        return parser_result<R>{std::move(x) , result->second};
+    return [p1 = std::forward<P1>(p1) , p2 = std::forward<P2>(p2)](parser_string str) -> parser_result<R>{
+        auto r1 = p1(str);
+        if(!r1) return {};
+        return p2(r1->second);
     };
 }
 
@@ -100,11 +98,12 @@ constexpr Parser auto operator >> (P1 && p1 , P2 && p2 ){
 template<Parser P1 , Parser P2>
 constexpr Parser auto operator << (P1 && p1 , P2 && p2 ){
     using R = typename parser_traits<P1>::type;
-    return [=](parser_string str)-> parser_result<R>{
-        auto result = chain_parse(str , p1 , p2);
-        if(!result) return {};
-        auto && [ x , _ ] = result->first;
-        return parser_result<R>{std::move(x) , result->second};
+    return [p1 = std::forward<P1>(p1) , p2 = std::forward<P2>(p2)](parser_string str)-> parser_result<R>{
+        auto r1 = p1(str);
+        if(!r1) return {};
+        auto r2 = p2(r1->second);
+        if(!r2) return {};
+        return parser_result<R>{std::move(r1->first) , r2->second};
     };
 }
 
@@ -112,74 +111,85 @@ constexpr Parser auto operator << (P1 && p1 , P2 && p2 ){
 
 template<Parser P>
 constexpr Parser auto skip(P p){
-    return p >> result(none_t{});
+    return std::move(p) >> result(none_t{});
 }
 
 //parser a -> parser maybe a
 template<Parser P>
 constexpr Parser auto option(P && p){
     using R = std::optional<typename parser_traits<P>::type>;
-    return [=](parser_string str) -> parser_result<R>{
+    return [p = std::forward<P>(p)](parser_string str) -> parser_result<R>{
         auto res = p(str);
-        if(!res)return std::pair{R{} , str};
-        else    return std::pair{res->first , res->second};
+        if(!res)return parser_result<R>{R{} , str};
+        else    return parser_result<R>{std::move(res->first) , res->second};
     };
 }
 
 template<Parser ...Ps>
 constexpr Parser auto andp(Ps && ...ps){
-    return [=](parser_string str){
+    return [...ps = std::forward<Ps>(ps)](parser_string str){
         return chain_parse(str , ps...);
     };
 }
 
 /// many , sepby , chainl , chainr
 
+//parser a -> [a]& -> parser int
+//appends every a to the caller's out instead of a list of its own , and counts them
+template<Parser P , Sink<typename parser_traits<P>::type> C>
+constexpr Parser auto many_into(P && p , C & out){
+    return [p = std::forward<P>(p) , &out](parser_string str)->parser_result<std::size_t>{
+        return many_parse(str , p , out);
+    };
+}
+
+//parser a -> parser b -> [a]& -> parser int
+template<Parser P , Parser S , Sink<typename parser_traits<P>::type> C>
+constexpr Parser auto sepby_into(P && p , S && sep , C & out){
+    return [p = std::forward<P>(p) , sep = std::forward<S>(sep) , &out](parser_string str)->parser_result<std::size_t>{
+        if(auto res = sepby_parse(str , p , sep , out)) return res;
+        return std::pair{std::size_t{0} , str};
+    };
+}
+
 template<Parser P >
-constexpr Parser auto many1(P && p){
+constexpr Parser auto many(P && p){
     using T = typename parser_traits<P>::type;
     if constexpr (std::is_same_v<none_t , std::remove_cvref_t<T>>){
-        return [=](parser_string str)->parser_result<none_t>{
-            return foldl_parse(str , p , none_t{} , [](auto && none , auto && _){return none;});
+        return [p = std::forward<P>(p)](parser_string str)->parser_result<none_t>{
+            while(auto res = p(str)) str = res->second;
+            return std::pair{none_t{} , str};
         };
     }else{
         using list_t = cexpr::vector<T>;
-        return [=](parser_string str)->parser_result<list_t>{
-            return foldl_parse(str , p , list_t{} , [](list_t && c , T && v ){
-                c.push_back(std::move(v));
-                return std::move(c);
-            });
+        return [p = std::forward<P>(p)](parser_string str)->parser_result<list_t>{
+            list_t ls{};
+            auto res = many_parse(str , p , ls);
+            return parser_result<list_t>{std::move(ls) , res->second};
         };
     }
 }
 
 template<Parser P >
-constexpr Parser auto many(P && p){
-    using T = typename parser_traits<P>::type;
-    if constexpr (std::is_same_v<none_t , std::remove_cvref_t<T>>){
-        return many1(std::forward<P>(p)) | result(none_t{});
-    }else
-        return many1(std::forward<P>(p)) | result_default<cexpr::vector<T>>;
+constexpr Parser auto many1(P && p){
+    using R = typename parser_traits<decltype(many(std::forward<P>(p)))>::type;
+    return [m = many(std::forward<P>(p))](parser_string str)->parser_result<R>{
+        auto res = m(str);
+        //nothing taken from the input , so not a single p
+        if(res->second.size() == str.size()) return {};
+        return res;
+    };
 }
 
 template<Parser P , Parser S>
 constexpr Parser auto sepby1(P && p , S && sep){
     using R = typename parser_traits<P>::type;
     using list_t = cexpr::vector<R>;
-    return [=](parser_string str)->parser_result<list_t>{
-        auto result = p(str);
-        if(!result) return {};
-        list_t ls{std::move(result->first)};
-        auto remain = result->second;
-        for(;;){
-            auto sep_res = sep(remain);
-            if(!sep_res) break;
-            result = p(sep_res->second);
-            if(!result) break;
-            remain = result->second;
-            ls.push_back(result->first);
-        }
-        return parser_result<list_t>(std::move(ls) , remain);
+    return [p = std::forward<P>(p) , sep = std::forward<S>(sep)](parser_string str)->parser_result<list_t>{
+        list_t ls{};
+        auto res = sepby_parse(str , p , sep , ls);
+        if(!res) return {};
+        return parser_result<list_t>{std::move(ls) , res->second};
     };
 } 
 
@@ -190,4 +200,4 @@ constexpr Parser auto sepby(P && p , S && sep){
     return sepby1(std::forward<P>(p) , std::forward<S>(sep)) | result_default<R>;
 }
 
-};
\ No newline at end of file
+};
@@ -3,21 +3,28 @@
 
 namespace pscpp{
 
+//runs ps in order , then hands k what remains and their values , each moved once .
+//the values wait in the frames of the calls , no tuple is built on the way .
+template<class R , class K>
+constexpr auto chain_apply(parser_string str , K && k) -> parser_result<R>{
+    return k(str);
+}
+
+template<class R , class K , Parser P , Parser ...Ps>
+constexpr auto chain_apply(parser_string str , K && k , P && p , Ps && ...ps) -> parser_result<R>{
+    auto result = p(str);
+    if(!result) return {};
+    return chain_apply<R>(result->second , [&](parser_string remain , auto && ...xs) -> parser_result<R>{
+        return k(remain , std::move(result->first) , std::forward<decltype(xs)>(xs)...);
+    } , std::forward<Ps>(ps)...);
+}
+
 template<Parser P , Parser ...Ps>
 constexpr auto chain_parse(parser_string str , P && p ,Ps && ...ps) -> parser_result<product_result_type<P , Ps...>>{
-    auto result = p(str);
-    if constexpr (sizeof...(ps) == 0){
-        if(!result) return {};
-        return std::pair{std::tuple{result->first} , result->second};
-    }else{
-        if(!result) return {};
-        auto cons_result = chain_parse(result->second , std::forward<Ps>(ps)...);
-        if(!cons_result) return {};
-        return std::pair{
-            std::tuple_cat(std::tuple{result->first} , cons_result->first) , 
-            cons_result->second
-        };
-    }
+    using R = product_result_type<P , Ps...>;
+    return chain_apply<R>(str , [](parser_string remain , auto && ...xs){
+        return parser_result<R>{R{std::forward<decltype(xs)>(xs)...} , remain};
+    } , std::forward<P>(p) , std::forward<Ps>(ps)...);
 }
 
 template<Parser P , class T , class ACC>
@@ -35,4 +42,34 @@ constexpr auto foldl_parse(parser_string str ,P && p , T && t , ACC && acc ) ->
     };
 }
 
+//appends what p parses to out , for as long as it parses , and counts it
+template<Parser P , Sink<typename parser_traits<P>::type> C>
+constexpr auto many_parse(parser_string str , P && p , C & out) -> parser_result<std::size_t>{
+    std::size_t n = 0;
+    while(auto result = p(str)){
+        out.push_back(std::move(result->first));
+        str = result->second;
+        ++n;
+    }
+    return std::pair{n , str};
+}
+
+//appends p , then each p after a sep to out , and counts them . fails if there is not a first p
+template<Parser P , Parser S , Sink<typename parser_traits<P>::type> C>
+constexpr auto sepby_parse(parser_string str , P && p , S && sep , C & out) -> parser_result<std::size_t>{
+    auto result = p(str);
+    if(!result) return {};
+    std::size_t n = 0;
+    for(;;){
+        out.push_back(std::move(result->first));
+        str = result->second;
+        ++n;
+        auto sep_res = sep(str);
+        if(!sep_res) break;
+        result = p(sep_res->second);
+        if(!result) break;
+    }
+    return std::pair{n , str};
+}
+
 };
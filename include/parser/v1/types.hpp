@@ -56,6 +56,12 @@ concept FMapFn = (... && Parser<Args>) &&
     !std::is_same_v<void , std::invoke_result_t<F , typename parser_traits<Args>::type...>>;
 
 
+//a container parsed values are appended to
+template<class C , class T>
+concept Sink = requires(C & c , T && t){
+    c.push_back(std::forward<T>(t));
+};
+
 template<Parser ...Ps>
 using product_result_type = std::tuple<typename parser_traits<Ps>::type ...>;
 
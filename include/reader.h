@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace lispy::ast{
+
+    // splits input arriving in chunks of any size , read() from a pipe say , into its top-level forms.
+    // a form is complete once its closing paren arrives , or for a bare atom the byte after it ,
+    // only what follows the last complete form stays buffered.
+    // forms are only delimited here , parse reports what is malformed in them.
+    class form_reader{
+    public:
+        void feed(std::string_view chunk);
+        // no input follows , a trailing atom is complete and an unclosed form is returned as is
+        void finish() noexcept { _finished = true; }
+
+        // the next complete form , valid until the next call to feed or next
+        std::optional<std::string_view> next();
+
+        // bytes held for the unfinished form
+        std::size_t buffered() const noexcept { return _buf.size() - _begin; }
+
+    private:
+        static constexpr auto npos = std::string::npos;
+
+        std::string _buf{};
+        std::size_t _begin{0};      // what precedes was returned already
+        std::size_t _pos{0};        // what precedes was scanned
+        std::size_t _start{npos};   // of the form being scanned
+        std::size_t _depth{0};      // lists open in it
+        bool _atom{false};          // it is a bare atom
+        bool _finished{false};
+    };
+
+}
@@ -4,90 +4,175 @@
 #include <unordered_map> 
 #include <vector>
 #include <memory>
+#include <utility>
 
 #include "lispy.h"
 #include "ast.h"
+#include "gc.h"
+#include "stats.h"
+#include "vm.h"
 
 namespace lispy{
 
-    //scope
+    // sexpr with what the running form allocated in its arena copied out of it , compiled code included .
+    // the rest outlives the form already and stays shared , so a defined value keeps its identity
+    ast::SExpr promote(const ast::SExpr & sexpr);
+
+    //global scope , a name keeps the same slot for the whole run ,
+    //so references resolved to it ( ast::GlobalRef ) skip the hashing.
     class Environment{
-        std::unordered_map<std::string_view , ast::SExpr> env{};
+        std::unordered_map<ast::Symbol , std::size_t> _index{};
+        std::vector<std::optional<ast::SExpr>> _slots{};
+        std::size_t _version{next_version()};
+
+        // unique across environments , so a cache never mistakes one for another
+        static std::size_t next_version() noexcept {
+            static std::size_t n = 0;
+            return ++n;
+        }
     public:
-        bool contains(std::string_view s) const {
-            return env.contains(s);
+        Environment() { LISPY_COUNT(environments); }
+
+        bool contains(ast::Symbol s) const {
+            auto it = _index.find(s);
+            return it != _index.end() && _slots[it->second].has_value();
         } 
-        auto get(std::string_view s) -> std::optional<ast::SExpr> const {
-            auto it = env.find(s);
-            return it == env.end() ? std::nullopt : std::optional{it->second};
+        auto get(ast::Symbol s) -> std::optional<ast::SExpr> const {
+            auto it = _index.find(s);
+            return it == _index.end() ? std::nullopt : _slots[it->second];
+        }
+        void set(ast::Symbol s , ast::SExpr sexpr){
+            // globals outlive the form defining them
+            _slots[slot(s)] = arena::current() ? promote(sexpr) : std::move(sexpr);
+            _version = next_version();
+        }
+        // slot of s , reserved unbound until the first set
+        std::size_t slot(ast::Symbol s){
+            auto [it , inserted] = _index.try_emplace(s , _slots.size());
+            if(inserted){
+                _slots.emplace_back();
+                _version = next_version();
+            }
+            return it->second;
+        }
+        // changes whenever a value may have been rebound or moved , see vm::GlobalSite
+        std::size_t version() const noexcept{
+            return _version;
         }
-        void set(std::string_view s , ast::SExpr sexpr){
-            env.insert_or_assign(s , std::move(sexpr));
+        const std::optional<ast::SExpr> & at(std::size_t slot) const {
+            return _slots[slot];
         }
+        void trace(gc::tracer & t) const {
+            for(auto & value : _slots) if(value) t.mark(*value);
+        }
+    };
+
+    //arguments and captured values of a running tree-walker call
+    struct Frame{
+        ast::vector<ast::SExpr> slots;
+        ast::SExpr closure;     // the Lambda called , it holds the captured values and the body
     };
 
     //Closure
     class Closure {
-        std::vector<std::reference_wrapper<Environment>> _cls{};
+        Environment & _global;
+        const Frame * _frame{nullptr};
     public:
-        struct pop_guard{
-            Closure & rcls;
-            explicit pop_guard(Closure & ref) noexcept : rcls(ref) {}
-            pop_guard(const pop_guard & ) = delete;
-            pop_guard(pop_guard && ) = delete;
-            ~pop_guard() { rcls.pop();}
+        //restores the frame that was current at its creation
+        struct frame_guard{
+            Closure * rcls;
+            const Frame * saved;
+            explicit frame_guard(Closure & ref) noexcept : rcls(&ref) , saved(ref._frame) {}
+            frame_guard(const frame_guard & ) = delete;
+            frame_guard(frame_guard && g) noexcept 
+            : rcls(std::exchange(g.rcls , nullptr)) , saved(g.saved) {}
+            ~frame_guard() { if(rcls) rcls->_frame = saved;}
         };
     public :
         Closure(Environment & global) 
-        : _cls{std::ref(global)} {}
+        : _global(global) {}
 
+        //global lookup by name , for references that were not resolved
         [[nodiscard]]
-        std::optional<ast::SExpr> find(std::string_view name) noexcept;
+        std::optional<ast::SExpr> find(ast::Symbol name) noexcept;
 
-        [[nodiscard]]
-        pop_guard push(Environment & env){
-            _cls.emplace_back(std::ref(env));    
-            return pop_guard{*this};
+        const ast::SExpr & local(std::size_t slot) const noexcept{
+            return _frame->slots[slot];
         }
 
-        Environment & global(){
-            return * _cls.begin();
+        const ast::SExpr & capture(std::size_t index) const noexcept{
+            return _frame->closure.get<ast::Lambda>().captures()[index];
+        }
+
+        void set_frame(const Frame * frame) noexcept{
+            _frame = frame;
         }
-    protected:
-        void pop() noexcept{
-            if(!_cls.empty()) _cls.pop_back();
+
+        Environment & global(){
+            return _global;
         }
     };
 
+    bool is_need_quote(const ast::SExpr & e);
+
+    // lambda calling fn with its parameters , what partial applications of a builtin curry
+    ast::SExpr builtin_lambda(const ast::BuiltinFn & fn);
+
+    enum class eval_mode{
+        tree_walk ,     // Runtime::eval_sexpr , walks the ast
+        bytecode ,      // vm::compile + vm::Machine
+    };
+
     //variable type 
     class Runtime {
         Runtime() ;
     public:
-        using builtin_func = ast::SExpr (*) (Closure & , ast::List & );
+        using builtin_func = ast::builtin_func;
 
         static Runtime & instance() {
             static Runtime rt{};   return rt;
         }
         
-        static builtin_func get_builtin_func(std::string_view name){
-            return instance()._builtin_functions.at(name);
-        }
+        static eval_mode mode() { return instance()._mode; }
+        static void set_mode(eval_mode mode) { instance()._mode = mode; }
 
-        static bool is_builtin_function(std::string_view name){
-            return instance()._builtin_functions.contains(name);
-        }
+        // limit of pending non-tail calls in eval_mode::bytecode
+        static std::size_t max_depth() { return instance()._vm.max_depth(); }
+        static void set_max_depth(std::size_t depth) { instance()._vm.set_max_depth(depth); }
+
+        // limit of pending non-tail calls in eval_mode::tree_walk . they nest on the native stack ,
+        // so it is far below max_depth() , raise it only along with the stack size
+        static constexpr std::size_t default_max_native_depth = 10'000;
+        static std::size_t max_native_depth() { return instance()._max_native_depth; }
+        static void set_max_native_depth(std::size_t depth) { instance()._max_native_depth = depth; }
 
         static std::string eval(std::string_view input);
-        static void eval_sexpr(Closure & cls ,ast::SExpr & sexpr);
+        static std::string eval(std::string_view input , eval_mode mode);
+        // evaluates the forms read from fd , a file or a pipe , as they arrive and until its end ,
+        // giving each result to on_result . returns how many were evaluated
+        static std::size_t load(int fd , const std::function<void(const std::string &)> & on_result = {});
+        static ast::SExpr eval_sexpr(Closure & cls , const ast::SExpr & sexpr);
+        static ast::SExpr execute(const ast::SExpr & sexpr);
+        static ast::SExpr apply(ast::SExpr f , ast::vector<ast::SExpr> args);
         static ast::SExpr quote(ast::SExpr e);
 
+        // collects the garbage of LISPY_GC builds , running is the code the vm runs if it called
+        static void collect(const vm::Function * running = nullptr);
+
+        // counters of LISPY_STATS builds , also what (runtime-stats) returns
+        static runtime_stats stats() noexcept;
+        static void reset_stats() noexcept;
+
     private:
         void init_builtins();
     private:
         // Environment _global_tmp;
         Environment _global{};
+        arena _arena{};
         Closure _cls;
-        std::unordered_map<std::string_view , builtin_func> _builtin_functions{};
+        vm::Machine _vm{_cls};
+        eval_mode _mode{eval_mode::bytecode};
+        std::size_t _max_native_depth{default_max_native_depth};
     };
 
 }
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+
+#include "constexpr_containers.hpp"
+
+namespace lispy{
+
+    // what the interpreter allocated and ran since the last Runtime::reset_stats ,
+    // only counted in LISPY_STATS builds , zero otherwise
+    struct runtime_stats{
+        std::size_t cow_allocs{0};      // cow blocks and heap allocated SExpr values
+        std::size_t cow_clones{0};
+        std::size_t vector_grows{0};
+        std::size_t environments{0};    // global environments and tree-walker call frames
+        std::size_t invocations{0};     // full applications of a lambda , in either mode
+        std::size_t builtin_calls{0};
+    };
+
+#ifdef LISPY_STATS
+    inline runtime_stats counters{};
+#define LISPY_COUNT(field) (++::lispy::counters.field)
+#else
+#define LISPY_COUNT(field) ((void)0)
+#endif
+
+}
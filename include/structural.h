@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "ast.h"
+
+namespace lispy{
+
+// first stage of parsing large inputs : classifies 64 bytes at a time and lists where tokens start ,
+// so the reader walks tokens and never looks at whitespace.
+namespace structural{
+
+    // instruction sets the classification runs with , detect picks the best the cpu has
+    enum class isa : uint8_t { scalar , sse2 , avx2 };
+    isa detect() noexcept;
+
+    // positions of every '(' , ')' and '\'' and of the first byte of every atom , in order.
+    // an atom is a run of any other bytes but whitespace , invalid ones included , the reader rejects those.
+    class indexer{
+    public:
+        // inputs must be shorter than 4 GiB , positions are 32 bits
+        static constexpr std::size_t max_input = UINT32_MAX;
+        // bytes classified per next
+        static constexpr std::size_t chunk = 64 * 1024;
+
+        explicit indexer(std::string_view input , isa with = detect()) noexcept
+        : _in(input) , _isa(with) {}
+
+        // replaces out with the positions in the next chunk , false when the input is done
+        bool next(std::vector<uint32_t> & out);
+
+    private:
+        std::string_view _in;
+        isa _isa;
+        std::size_t _pos{0};
+        // whether the byte before _pos is an atom byte
+        bool _in_atom{false};
+    };
+
+    // ast::parse walking an indexer with , same result for every input
+    std::optional<ast::SExpr> parse(std::string_view input , isa with = detect());
+
+}
+
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ast.h"
+
+namespace lispy{
+
+class Closure;
+
+namespace vm{
+
+    // one byte per opcode , operands follow inline :
+    //   u16 operands are little endian indices / absolute jump targets ,
+    //   u8  operand of call is the argument count.
+    enum class opcode : uint8_t {
+        constant ,          // u16 k   : push constants[k]
+        local ,             // u16 i   : push frame local i
+        capture ,           // u16 i   : push captured value i of the running closure
+        global ,            // u16 g   : push the global of globals[g]
+        define ,            // u16 k   : pop value , bind it to the global constants[k] , push the symbol
+        closure ,           // u16 f   : push a new closure of functions[f]
+        jump ,              // u16 to  : unconditional jump
+        jump_if_not_true ,  // u16 to  : pop , jump unless value is #t         (cond)
+        jump_if_false ,     // u16 to  : jump if top is #f , otherwise pop it  (and)
+        jump_if_true ,      // u16 to  : jump if top is #t , otherwise pop it  (or)
+        call ,              // u8 argc : invoke stack[top - argc] with argc arguments
+        tail_call ,         // u8 argc : as call , but a closure replaces the running frame
+        ret ,               //         : return top of stack to the caller
+        fail ,              // u16 e   : raise failures[e] , a form that cannot compile fails once it runs , as in the tree walker
+    };
+
+    // how closure instantiation fills a captured slot
+    struct Capture{
+        ast::Symbol name;
+        bool from_local;        // true : enclosing frame local , false : enclosing closure capture
+        uint16_t index;
+    };
+
+    // one global variable reference , caches where its value was found
+    // until the global environment changes version ( a define , a new name ).
+    struct GlobalSite{
+        ast::Symbol name;
+        mutable const ast::SExpr * value{nullptr};
+        mutable std::size_t version{0};
+    };
+
+    // error of a malformed form , raised by opcode::fail
+    struct Failure{
+        bool syntax;            // true : bad_syntax , false : runtime_error
+        std::string message;
+    };
+
+    // compiled code of a lambda body , or of a top-level form
+    struct Function{
+        std::vector<uint8_t> code{};
+        std::vector<ast::SExpr> constants{};
+        std::vector<GlobalSite> globals{};
+        // lambdas in the body , shared with every closure instantiated from them , compiled
+        std::vector<ast::cow<ast::LambdaCode>> functions{};
+        std::vector<Capture> captures{};
+        std::vector<Failure> failures{};
+    };
+
+    using FunctionPtr = std::shared_ptr<const Function>;
+
+    // compile a top-level form into a parameterless function
+    [[nodiscard]] FunctionPtr compile(const ast::SExpr & sexpr);
+
+    // compile a lambda that was built without bytecode (builtin wrappers , tree-walker lambdas) ,
+    // outside the arena , code keeps it as compiled
+    [[nodiscard]] FunctionPtr compile(const ast::LambdaCode & code);
+
+    std::string disassemble(const Function & fn);
+
+    class Machine{
+    public:
+        static constexpr std::size_t default_max_depth = 10'000'000;
+
+        explicit Machine(Closure & cls) noexcept : _cls(cls) {}
+
+        // run a top-level function , the value stack is restored on exception .
+        // with safe_points , calls may collect garbage ( LISPY_GC ) : only for a run nothing else holds values around
+        ast::SExpr run(const Function & fn , bool safe_points = false);
+
+        // call a procedure value , same restoring rule as run
+        ast::SExpr apply(ast::SExpr f , ast::vector<ast::SExpr> args);
+
+        std::size_t max_depth() const noexcept { return _max_depth; }
+        void set_max_depth(std::size_t depth) noexcept { _max_depth = depth; }
+
+        // marks the value stack and the code of the waiting frames , running included
+        void trace(gc::tracer & t , const Function * running) const;
+
+    private:
+        // a caller waiting for its callee to return
+        struct Frame{
+            const Function * fn;
+            const uint8_t * ip;
+            std::size_t base;
+        };
+
+        ast::SExpr execute(const Function & fn , std::size_t base , bool safe_points);
+        void unwind(std::size_t stack , std::size_t frames) noexcept;
+        const Function * enter(std::size_t argc);
+        void call_builtin(std::size_t argc);
+        ast::SExpr make_closure(std::size_t base , const ast::cow<ast::LambdaCode> & code);
+
+    private:
+        Closure & _cls;
+        std::vector<ast::SExpr> _stack{};
+        std::vector<Frame> _frames{};
+        std::size_t _max_depth{default_max_depth};
+    };
+
+}
+
+}
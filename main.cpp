@@ -1,4 +1,6 @@
 #include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
 #include <string_view>
 #include <memory>
 #include <vector>
@@ -19,7 +21,6 @@ void put_version_info(){
 }
 
 using RAII_GuardString = std::unique_ptr<char , decltype(&free)>;
-std::vector<RAII_GuardString> history_codes{};
 
 struct repl_io{
     auto operator >> (std::function<std::string(std::string_view)> && f){
@@ -37,14 +38,29 @@ struct repl_io{
                 }catch(const std::exception & e){
                     fmt::print("{}\n",e.what());
                 }
-                history_codes.emplace_back(std::move(str_guard));
             }
         };
     }
 };
 
-auto main_loop = repl_io{} >> lispy::Runtime::eval ;
+auto main_loop = repl_io{} >> [](std::string_view input){ return lispy::Runtime::eval(input); };
 
-int main(){
-    main_loop();
+// lispy file... evaluates the files , - reads standard input , instead of starting the repl
+int main(int argc , char ** argv){
+    if(argc == 1) return main_loop() , 0;
+    for(int i = 1 ; i < argc ; ++i){
+        std::string_view path{argv[i]};
+        int fd = path == "-" ? STDIN_FILENO : open(argv[i] , O_RDONLY);
+        if(fd < 0){
+            fmt::print("cannot open {}\n" , path);
+            return 1;
+        }
+        try{
+            lispy::Runtime::load(fd , [](const std::string & result){ fmt::print("{}\n" , result); });
+        }catch(const std::exception & e){
+            fmt::print("{}\n" , e.what());
+            return 1;
+        }
+        if(fd != STDIN_FILENO) close(fd);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+#include "arena.h"
+
+namespace lispy {
+
+void * arena::allocate(std::size_t n , std::size_t align) noexcept{
+    if(_paused) return nullptr;
+    auto aligned = [&]{
+        auto top = reinterpret_cast<std::uintptr_t>(_top);
+        return reinterpret_cast<std::byte *>((top + align - 1) & ~(align - 1));
+    };
+    if(!_top || aligned() + n > _end){
+        if(!grow(n + align)) return spill(n , align);
+    }
+    auto p = aligned();
+    _top = p + n;
+    return p;
+}
+
+// chunks double , so a form allocating m bytes owns O(log m) of them
+bool arena::grow(std::size_t n) noexcept{
+    auto size = std::max(n , _chunks.empty() ? first_chunk : 2 * _chunks.back().size);
+    if(_reserved + size > _max_size) return false;
+    std::byte * begin = nullptr;
+    try{
+        begin = static_cast<std::byte *>(::operator new(size));
+        _chunks.push_back(chunk{begin , size});
+    }catch(...){
+        ::operator delete(begin);
+        return false;
+    }
+    _reserved += size;
+    _top = begin;
+    _end = begin + size;
+    return true;
+}
+
+// recorded , so what the form builds there is still known as a temporary
+void * arena::spill(std::size_t n , std::size_t align) noexcept{
+    if(align > __STDCPP_DEFAULT_NEW_ALIGNMENT__) return nullptr;
+    void * p = nullptr;
+    try{
+        p = ::operator new(n);
+        _spilled.emplace(reinterpret_cast<std::uintptr_t>(p) , n);
+    }catch(...){
+        ::operator delete(p);
+        return nullptr;
+    }
+    return p;
+}
+
+bool arena::deallocate(void * p) noexcept{
+    if(in_chunks(p)) return true;
+    auto it = _spilled.find(reinterpret_cast<std::uintptr_t>(p));
+    if(it == _spilled.end()) return false;
+    _spilled.erase(it);
+    ::operator delete(p);
+    return true;
+}
+
+arena::~arena(){
+    for(auto & c : _chunks) ::operator delete(c.begin);
+}
+
+bool arena::in_chunks(const void * p) const noexcept{
+    auto b = reinterpret_cast<std::uintptr_t>(p);
+    return std::ranges::any_of(_chunks , [b](const chunk & c){
+        auto begin = reinterpret_cast<std::uintptr_t>(c.begin);
+        return begin <= b && b < begin + c.size;
+    });
+}
+
+bool arena::owns(const void * p) const noexcept{
+    if(in_chunks(p)) return true;
+    if(_spilled.empty()) return false;
+    // the last block starting at or before p
+    auto b = reinterpret_cast<std::uintptr_t>(p);
+    auto it = _spilled.upper_bound(b);
+    if(it == _spilled.begin()) return false;
+    --it;
+    return b < it->first + it->second;
+}
+
+// chunks grow in size order , the one kept is the last small enough
+void arena::release() noexcept{
+    _spilled.clear();
+    if(_chunks.empty()) return;
+    auto kept = _chunks.front();
+    for(auto & c : _chunks){
+        if(c.begin != kept.begin && c.size <= max_retained){
+            ::operator delete(kept.begin);
+            kept = c;
+        }else if(c.begin != kept.begin){
+            ::operator delete(c.begin);
+        }
+    }
+    _chunks.assign(1 , kept);
+    _reserved = _chunks[0].size;
+    _top = _chunks[0].begin;
+    _end = _top + _chunks[0].size;
+}
+
+}
@@ -0,0 +1,355 @@
+#include <ranges>
+#include <unordered_map>
+#include <fmt/format.h>
+
+#include "ast.h"
+#include "lispy.h"
+#include "runtime.h"
+#include "vm.h"
+
+using std::ranges::subrange;
+using namespace std::literals;
+
+namespace lispy::vm {
+
+namespace {
+
+// lexical scope of the function being compiled
+struct Scope{
+    Function & fn;
+    ast::short_vector<ast::Symbol> locals;
+    Scope * enclosing;
+};
+
+enum class binding_kind { local , capture , global };
+
+struct Binding{
+    binding_kind kind;
+    uint16_t index;
+};
+
+constexpr std::size_t max_operand = 0xffff;
+
+void emit(Function & fn , opcode op){
+    fn.code.push_back(static_cast<uint8_t>(op));
+}
+
+void emit(Function & fn , opcode op , std::size_t operand){
+    if(operand > max_operand)
+        throw internal_error{fmt::format("operand out of range : {}" , operand)};
+    emit(fn , op);
+    fn.code.push_back(static_cast<uint8_t>(operand & 0xff));
+    fn.code.push_back(static_cast<uint8_t>(operand >> 8));
+}
+
+// emit a forward jump , return the position of its operand for patching
+std::size_t emit_jump(Function & fn , opcode op){
+    emit(fn , op , 0);
+    return fn.code.size() - 2;
+}
+
+void patch_jump(Function & fn , std::size_t pos){
+    auto target = fn.code.size();
+    if(target > max_operand)
+        throw internal_error{"function too large , jump out of range."};
+    fn.code[pos]     = static_cast<uint8_t>(target & 0xff);
+    fn.code[pos + 1] = static_cast<uint8_t>(target >> 8);
+}
+
+// a malformed form is an error only if it runs , the body of a lambda never called may hold one
+template<class Error>
+void emit_failure(Function & fn , const Error & e){
+    fn.failures.push_back(Failure{.syntax = std::is_same_v<Error , bad_syntax> , .message = e.what()});
+    emit(fn , opcode::fail , fn.failures.size() - 1);
+}
+
+std::size_t add_constant(Function & fn , ast::SExpr value){
+    fn.constants.emplace_back(std::move(value));
+    return fn.constants.size() - 1;
+}
+
+std::size_t add_symbol(Function & fn , ast::Symbol sym){
+    for(std::size_t i = 0 ; i < fn.constants.size() ; ++i){
+        if(auto s = fn.constants[i].get_if<ast::Symbol>() ; s && *s == sym) return i;
+    }
+    return add_constant(fn , sym);
+}
+
+// every reference gets its own site , and so its own cache
+std::size_t add_global(Function & fn , ast::Symbol name){
+    fn.globals.push_back(GlobalSite{.name = name});
+    return fn.globals.size() - 1;
+}
+
+Binding resolve(Scope & scope , ast::Symbol name){
+    // later bindings shadow earlier ones , same as Environment::set
+    for(auto i = scope.locals.size() ; i-- > 0 ;)
+        if(scope.locals[i] == name) return {binding_kind::local , static_cast<uint16_t>(i)};
+
+    auto & captures = scope.fn.captures;
+    for(auto i = captures.size() ; i-- > 0 ;)
+        if(captures[i].name == name) return {binding_kind::capture , static_cast<uint16_t>(i)};
+
+    if(scope.enclosing){
+        auto outer = resolve(*scope.enclosing , name);
+        if(outer.kind != binding_kind::global){
+            if(captures.size() > max_operand)
+                throw internal_error{"too many captured variables."};
+            captures.push_back(Capture{
+                .name = name ,
+                .from_local = outer.kind == binding_kind::local ,
+                .index = outer.index
+            });
+            return {binding_kind::capture , static_cast<uint16_t>(captures.size() - 1)};
+        }
+    }
+    return {binding_kind::global , 0};
+}
+
+void compile_sexpr(Scope & scope , const ast::SExpr & sexpr , bool tail);
+
+void compile_body(Function & fn , Scope & scope , const ast::SExpr & body){
+    compile_sexpr(scope , body , true);
+    emit(fn , opcode::ret);
+}
+
+void compile_def(Scope & scope , const ast::List & list , bool){
+    if(list->size() != 3 || !list.ref()[1].holds<ast::Symbol>() )
+        throw bad_syntax(fmt::format(
+            "define : bad syntax in {}." , ast::print_sexpr(ast::SExpr{list})));
+
+    compile_sexpr(scope , list.ref()[2] , false);
+    emit(scope.fn , opcode::define , add_symbol(scope.fn , list.ref()[1].get<ast::Symbol>()));
+}
+
+void compile_lambda(Scope & scope , const ast::List & list , bool){
+    if(list->size() != 3 || !list.ref()[1].holds<ast::List>())
+        throw bad_syntax(fmt::format("lambda : bad syntax , in {} . " , ast::print_sexpr(ast::SExpr{list})));
+
+    auto & params = list.ref()[1].get<ast::List>();
+    for(auto & e : params.ref())
+        if(!e.holds<ast::Symbol>())
+            throw bad_syntax(fmt::format("lambda : bad syntax , expect a symbol , in {} . ",ast::print_sexpr(e)));
+
+    ast::LambdaCode code{};
+    for(auto & e : params.ref())
+        code.var_names.emplace_back(e.get<ast::Symbol>());
+    code.body = list.ref()[2];
+
+    auto fn = std::make_shared<Function>();
+    Scope inner{*fn , code.var_names , &scope};
+    compile_body(*fn , inner , code.body);
+    for(auto & c : fn->captures){
+        if(c.from_local) code.captures.emplace_back(ast::LocalRef{c.index , c.name});
+        else code.captures.emplace_back(ast::CaptureRef{c.index , c.name});
+    }
+    code.compiled = std::move(fn);
+
+    scope.fn.functions.emplace_back(std::move(code));
+    emit(scope.fn , opcode::closure , scope.fn.functions.size() - 1);
+}
+
+void compile_cond(Scope & scope , const ast::List & list , bool tail){
+    if(list->size() < 3 )
+        throw bad_syntax(fmt::format("cond : bad syntax , in {} ." , ast::print_sexpr(list)));
+
+    for(auto & e : subrange(list.ref().begin() + 1 , list.ref().end()))
+        if(!e.holds<ast::List>() || e.get_if<ast::List>()->ref().size() != 2)
+            throw bad_syntax(fmt::format("cond : bad syntax , in {}" , ast::print_sexpr(e)));
+
+    auto & else_var = (list.ref().end() - 1)->get<ast::List>();
+    if(else_var.ref()[0] != ast::Symbol{"else"})
+        throw bad_syntax(fmt::format("cond : bad syntax in {} , expect (else S-Expression)" , ast::print_sexpr(list)));
+
+    std::vector<std::size_t> exits{};
+    for(auto & e : subrange(list.ref().begin() + 1 , list.ref().end() - 1)){
+        auto & pair = e.get<ast::List>();
+        compile_sexpr(scope , pair.ref()[0] , false);
+        auto next = emit_jump(scope.fn , opcode::jump_if_not_true);
+        compile_sexpr(scope , pair.ref()[1] , tail);
+        exits.push_back(emit_jump(scope.fn , opcode::jump));
+        patch_jump(scope.fn , next);
+    }
+    compile_sexpr(scope , else_var.ref()[1] , tail);
+    for(auto pos : exits) patch_jump(scope.fn , pos);
+}
+
+// and / or : leave the first deciding operand on the stack , otherwise yield the last one
+void compile_logic(Scope & scope , const ast::List & list , bool tail , opcode short_circuit){
+    if(list->size() <= 1)
+        throw runtime_error{"parameters cannot be empty."};
+
+    std::vector<std::size_t> exits{};
+    for(auto & e : subrange(list.ref().begin() + 1 , list.ref().end() - 1)){
+        compile_sexpr(scope , e , false);
+        exits.push_back(emit_jump(scope.fn , short_circuit));
+    }
+    compile_sexpr(scope , *(list.ref().end() - 1) , tail);
+    for(auto pos : exits) patch_jump(scope.fn , pos);
+}
+
+void compile_and(Scope & scope , const ast::List & list , bool tail){
+    compile_logic(scope , list , tail , opcode::jump_if_false);
+}
+
+void compile_or(Scope & scope , const ast::List & list , bool tail){
+    compile_logic(scope , list , tail , opcode::jump_if_true);
+}
+
+using syntax_compiler = void (*)(Scope & , const ast::List & , bool);
+const std::unordered_map<ast::Symbol , syntax_compiler> builtin_syntax {
+    {"define"sv , compile_def},
+    {"lambda"sv , compile_lambda},
+    {"cond"sv   , compile_cond},
+    {"and"sv    , compile_and},
+    {"or"sv     , compile_or} ,
+};
+
+void compile_list(Scope & scope , const ast::List & list , bool tail){
+    if(list->size() == 0)
+        return emit_failure(scope.fn , runtime_error("missing procedure expression , given emtpy ()."));
+
+    auto & head = *(list->begin());
+    if(auto iden = head.get_if<ast::Symbol>() ; iden && builtin_syntax.contains(*iden)){
+        // what it emitted before finding it malformed is dropped , the rest of the body still compiles
+        auto emitted = scope.fn.code.size();
+        try{
+            return builtin_syntax.at(*iden)(scope , list , tail);
+        }catch(const bad_syntax & e){
+            scope.fn.code.resize(emitted);
+            return emit_failure(scope.fn , e);
+        }catch(const runtime_error & e){
+            scope.fn.code.resize(emitted);
+            return emit_failure(scope.fn , e);
+        }
+    }
+
+    auto argc = list->size() - 1;
+    if(argc > 0xff)
+        throw runtime_error(fmt::format("too many arguments , got {}" , argc));
+    for(auto & e : list.ref()) compile_sexpr(scope , e , false);
+    emit(scope.fn , tail ? opcode::tail_call : opcode::call);
+    scope.fn.code.push_back(static_cast<uint8_t>(argc));
+}
+
+void compile_symbol(Scope & scope , ast::Symbol name){
+    auto binding = resolve(scope , name);
+    switch(binding.kind){
+    case binding_kind::local   : return emit(scope.fn , opcode::local   , binding.index);
+    case binding_kind::capture : return emit(scope.fn , opcode::capture , binding.index);
+    case binding_kind::global  : return emit(scope.fn , opcode::global  , add_global(scope.fn , name));
+    }
+}
+
+// closure of a lambda nested in a tree-walker lambda body , its captures are already resolved ,
+// so its code compiles the same wherever it is
+void compile_lambda_form(Scope & scope , const ast::LambdaForm & form){
+    if(!form.code->compiled) form.code->compiled = compile(*form.code);
+    scope.fn.functions.emplace_back(form.code);
+    emit(scope.fn , opcode::closure , scope.fn.functions.size() - 1);
+}
+
+void compile_sexpr(Scope & scope , const ast::SExpr & sexpr , bool tail){
+    sexpr.match(overloaded{
+        [&](const ast::List & list){
+            compile_list(scope , list , tail);
+        },
+        [&](const ast::Symbol & name){
+            compile_symbol(scope , name);
+        },
+        [&](const ast::LocalRef & ref){
+            emit(scope.fn , opcode::local , ref.slot);
+        },
+        [&](const ast::CaptureRef & ref){
+            emit(scope.fn , opcode::capture , ref.index);
+        },
+        [&](const ast::LambdaForm & form){
+            compile_lambda_form(scope , form);
+        },
+        [&](const ast::GlobalRef & ref){
+            emit(scope.fn , opcode::global , add_global(scope.fn , ref.name));
+        },
+        [&](const ast::Quote & q){
+            // same rule as Runtime::eval_sexpr , data stays quoted , literals unwrap
+            auto value = is_need_quote(q.ref()) ? sexpr : q.ref();
+            emit(scope.fn , opcode::constant , add_constant(scope.fn , std::move(value)));
+        },
+        [&](const auto &){
+            emit(scope.fn , opcode::constant , add_constant(scope.fn , sexpr));
+        },
+    });
+}
+
+}
+
+FunctionPtr compile(const ast::SExpr & sexpr){
+    auto fn = std::make_shared<Function>();
+    Scope top{*fn , {} , nullptr};
+    compile_body(*fn , top , sexpr);
+    return fn;
+}
+
+FunctionPtr compile(const ast::LambdaCode & code){
+    arena::pause heap{};
+    auto fn = std::make_shared<Function>();
+    for(auto & ref : code.captures){
+        auto local = ref.get_if<ast::LocalRef>();
+        auto capture = ref.get_if<ast::CaptureRef>();
+        fn->captures.push_back(Capture{
+            .name = local ? local->name : capture->name ,
+            .from_local = local != nullptr ,
+            .index = static_cast<uint16_t>(local ? local->slot : capture->index)
+        });
+    }
+
+    Scope scope{*fn , code.var_names , nullptr};
+    compile_body(*fn , scope , code.body);
+    return fn;
+}
+
+std::string disassemble(const Function & fn){
+    std::string out{};
+    auto & code = fn.code;
+    for(std::size_t pc = 0 ; pc < code.size() ; ){
+        auto at = pc;
+        auto op = static_cast<opcode>(code[pc++]);
+        auto u16 = [&]{
+            std::size_t v = code[pc] | (code[pc + 1] << 8);
+            pc += 2;
+            return v;
+        };
+        switch(op){
+        case opcode::constant :
+            out += fmt::format("{:04} constant {}\n" , at , ast::print_sexpr(fn.constants[u16()])); break;
+        case opcode::local :
+            out += fmt::format("{:04} local {}\n" , at , u16()); break;
+        case opcode::capture :
+            out += fmt::format("{:04} capture {}\n" , at , u16()); break;
+        case opcode::global :
+            out += fmt::format("{:04} global {}\n" , at , fn.globals[u16()].name); break;
+        case opcode::define :
+            out += fmt::format("{:04} define {}\n" , at , ast::print_sexpr(fn.constants[u16()])); break;
+        case opcode::closure :
+            out += fmt::format("{:04} closure {}\n" , at , u16()); break;
+        case opcode::jump :
+            out += fmt::format("{:04} jump {}\n" , at , u16()); break;
+        case opcode::jump_if_not_true :
+            out += fmt::format("{:04} jump_if_not_true {}\n" , at , u16()); break;
+        case opcode::jump_if_false :
+            out += fmt::format("{:04} jump_if_false {}\n" , at , u16()); break;
+        case opcode::jump_if_true :
+            out += fmt::format("{:04} jump_if_true {}\n" , at , u16()); break;
+        case opcode::call :
+            out += fmt::format("{:04} call {}\n" , at , code[pc++]); break;
+        case opcode::tail_call :
+            out += fmt::format("{:04} tail_call {}\n" , at , code[pc++]); break;
+        case opcode::ret :
+            out += fmt::format("{:04} ret\n" , at); break;
+        case opcode::fail :
+            out += fmt::format("{:04} fail {}\n" , at , fn.failures[u16()].message); break;
+        }
+    }
+    return out;
+}
+
+}
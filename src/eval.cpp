@@ -1,49 +1,72 @@
+#include <cerrno>
 #include <ranges>
 #include <functional>
+#include <system_error>
 #include <unordered_map>
+#include <vector>
+#include <unistd.h>
 #include <fmt/format.h>
 
 #include "ast.h"
 #include "lispy.h"
+#include "reader.h"
 #include "runtime.h"
 
 using std::ranges::subrange;
-using std::views::reverse;
 using namespace std::literals;
 
 namespace lispy {
 
 namespace {
 
-ast::SExpr eval_def(Closure & cls , ast::List & list){
+// non-tail calls nest Runtime::eval_sexpr on the native stack , refuse to go deeper
+// than Runtime::max_native_depth() instead of overflowing it .
+// eval_mode::bytecode keeps its frames on the heap.
+std::size_t native_depth = 0;
+
+struct depth_guard{
+    depth_guard(){
+        if(auto limit = Runtime::max_native_depth() ; native_depth >= limit)
+            throw runtime_error(fmt::format("maximum recursion depth {} exceeded." , limit));
+        ++native_depth;
+    }
+    depth_guard(const depth_guard &) = delete;
+    ~depth_guard() { --native_depth; }
+};
+
+// forms whose value is the value of one of their sub-expressions hand it back
+// unevaluated , Runtime::eval_sexpr then loops on it instead of recursing.
+// the ast is never written to , pending points into the code being run.
+struct Tail{
+    const ast::SExpr * pending{nullptr};    // the expression still to be evaluated
+    std::optional<Frame> frame{};           // frame of the function entered by a tail call , it keeps the body alive
+};
+
+ast::SExpr defer(Tail & tail , const ast::SExpr & sexpr){
+    tail.pending = &sexpr;
+    return ast::Boolean{false};
+}
+
+ast::SExpr eval_def(Closure & cls , const ast::List & list , Tail &){
     if(list->size() != 3 || !list.ref()[1].holds<ast::Symbol>() )
         throw bad_syntax(fmt::format(
             "define : bad syntax in {}." , ast::print_sexpr(ast::SExpr{list})));
     
     auto & iden = list.ref()[1];
-    auto value = list.ref()[2];
-    Runtime::eval_sexpr(cls , value);
-    cls.global().set(iden.get<ast::Symbol>() , value);
+    cls.global().set(iden.get<ast::Symbol>() , Runtime::eval_sexpr(cls , list.ref()[2]));
     return iden;
 }
 
-using FreeVarList= cexpr::cow<cexpr::vector<std::pair<std::string_view , ast::SExpr>>>;
-void scan_and_capture(Closure & cls , FreeVarList & free_vars , const ast::List & list){
-    for(auto & e : list.ref()){
-        e.match(overloaded{
-            [&](ast::Symbol sym){
-                auto var = cls.find(sym);
-                if(var) free_vars.mut().emplace_back(sym , *var);
-            },
-            [&](const ast::List & list){
-                scan_and_capture(cls , free_vars , list);
-            },
-            [](auto && _){}
-        });
-    }
-}
+// lambda whose body is being resolved , it captures what the enclosing ones bind
+struct Scope{
+    const ast::short_vector<ast::Symbol> & names;
+    Scope * enclosing;
+    ast::short_vector<ast::SExpr> captures{};   // LocalRef / CaptureRef in the enclosing lambda
+};
+
+ast::SExpr resolve(Environment & global , Scope & scope , const ast::SExpr & sexpr);
 
-ast::SExpr eval_lambda(Closure & cls , ast::List & list){
+ast::SExpr eval_lambda(Closure & cls , const ast::List & list , Tail &){
     if(list->size() != 3 || !list.ref()[1].holds<ast::List>()) 
         throw bad_syntax(fmt::format("lambda : bad syntax , in {} . " , ast::print_sexpr(ast::SExpr{list}))); 
 
@@ -52,43 +75,41 @@ ast::SExpr eval_lambda(Closure & cls , ast::List & list){
         if(!e.holds<ast::Symbol>()) 
             throw bad_syntax(fmt::format("lambda : bad syntax , expect a symbol , in {} . ",ast::print_sexpr(e)));
     
-    ast::Lambda lambda{.body = list.ref()[2]};
+    ast::LambdaCode code{};
 
     for(auto & e : params.ref()) 
-        lambda.var_names.mut().emplace_back(e.get<ast::Symbol>());
+        code.var_names.emplace_back(e.get<ast::Symbol>());
     
-    scan_and_capture(cls , lambda.free_vars , list);
+    // lambdas in a lambda body were turned into ast::LambdaForm , so this one has nothing to capture
+    Scope top{code.var_names , nullptr};
+    code.body = resolve(cls.global() , top , list.ref()[2]);
 
-    return lambda;
+    return ast::SExpr::lambda(std::move(code));
 }
 
-ast::SExpr eval_and(Closure & cls , ast::List & params){
+ast::SExpr eval_and(Closure & cls , const ast::List & params , Tail & tail){
     if(params->size() <= 1)
         throw runtime_error{"parameters cannot be empty."};
 
-    auto ref_result = std::ref(*params.mut().begin());
-    for(auto & conds: subrange(params.mut().begin() + 1 , params.mut().end())){
-        Runtime::eval_sexpr(cls , conds);
-        if(conds == ast::Boolean{false}) return conds;
-        else ref_result = std::ref(conds);
+    for(auto & conds: subrange(params.ref().begin() + 1 , params.ref().end() - 1)){
+        auto value = Runtime::eval_sexpr(cls , conds);
+        if(value == ast::Boolean{false}) return value;
     }
-    return ref_result.get();
+    return defer(tail , *(params.ref().end() - 1));
 }
 
-ast::SExpr eval_or(Closure & cls , ast::List & params){
+ast::SExpr eval_or(Closure & cls , const ast::List & params , Tail & tail){
     if(params->size() <= 1)
             throw runtime_error{"parameters cannot be empty."};
 
-    auto ref_result = std::ref(*params.mut().begin());
-    for(auto & conds : subrange(params.mut().begin() + 1 , params.mut().end())){
-        Runtime::eval_sexpr(cls , conds);
-        if(conds == ast::Boolean{true}) return conds;
-        else ref_result = std::ref(conds);
+    for(auto & conds : subrange(params.ref().begin() + 1 , params.ref().end() - 1)){
+        auto value = Runtime::eval_sexpr(cls , conds);
+        if(value == ast::Boolean{true}) return value;
     }
-    return ref_result;
+    return defer(tail , *(params.ref().end() - 1));
 }
 
-ast::SExpr eval_cond(Closure & cls , ast::List & list){
+ast::SExpr eval_cond(Closure & cls , const ast::List & list , Tail & tail){
     if(list->size() < 3 )
         throw bad_syntax(fmt::format("cond : bad syntax , in {} ." , ast::print_sexpr(list)));
 
@@ -101,27 +122,20 @@ ast::SExpr eval_cond(Closure & cls , ast::List & list){
             throw bad_syntax(fmt::format("cond : bad syntax , in {}" , ast::print_sexpr(e)));
 
     auto conds = subrange(branchs.begin() , branchs.end() - 1);
-    auto else_var = *(branchs.end() - 1);
+    auto & else_var = *(branchs.end() - 1);
     if(else_var.get_if<ast::List>()->ref()[0] != ast::Symbol{"else"})
         throw bad_syntax(fmt::format("cond : bad syntax in {} , expect (else S-Expression)" , ast::print_sexpr(list)));
     
     for(auto & e : conds){
         auto & pair = *e.get_if<ast::List>();
-        auto cond = pair.ref()[0];
-        Runtime::eval_sexpr(cls , cond);
-        if(cond == ast::Boolean{true}){
-            auto value = pair.ref()[1];
-            Runtime::eval_sexpr(cls , value);
-            return value;
-        }
+        if(Runtime::eval_sexpr(cls , pair.ref()[0]) == ast::Boolean{true})
+            return defer(tail , pair.ref()[1]);
     }
-    auto var = else_var.get_if<ast::List>()->ref()[1];
-    Runtime::eval_sexpr(cls , var);
-    return var;
+    return defer(tail , else_var.get_if<ast::List>()->ref()[1]);
 }
 
-std::unordered_map builtin_syntax {
-    std::pair
+using syntax_func = ast::SExpr (*)(Closure & , const ast::List & , Tail &);
+std::unordered_map<ast::Symbol , syntax_func> builtin_syntax {
     {"define"sv , eval_def},
     {"lambda"sv , eval_lambda},
     {"cond"sv   , eval_cond},
@@ -129,38 +143,130 @@ std::unordered_map builtin_syntax {
     {"or"sv     , eval_or} ,
 };
 
-ast::SExpr invoke_function(Closure & cls , ast::List & list){
-    auto & lambda = list.mut().begin()->get<ast::Lambda>();
-    auto n_except = lambda.var_names->size() - lambda.bounded->size();
+ast::Symbol captured_name(const ast::SExpr & ref){
+    if(auto local = ref.get_if<ast::LocalRef>()) return local->name;
+    return ref.get<ast::CaptureRef>().name;
+}
+
+// same lookup as the bytecode compiler : parameters , then captures ,
+// then the enclosing lambdas , capturing the variable on the way in.
+ast::SExpr resolve_symbol(Environment & global , Scope * scope , ast::Symbol name){
+    if(!scope) return ast::GlobalRef{global.slot(name) , name};
+
+    // later parameters shadow earlier ones
+    for(auto i = scope->names.size() ; i-- > 0 ;)
+        if(scope->names[i] == name) return ast::LocalRef{i , name};
+
+    auto & captures = scope->captures;
+    for(std::size_t i = 0 ; i < captures.size() ; ++i)
+        if(captured_name(captures[i]) == name) return ast::CaptureRef{i , name};
+
+    auto outer = resolve_symbol(global , scope->enclosing , name);
+    if(outer.holds<ast::GlobalRef>()) return outer;
+    captures.emplace_back(std::move(outer));
+    return ast::CaptureRef{captures.size() - 1 , name};
+}
+
+ast::SExpr resolve_list(Environment & global , Scope & scope , const ast::List & list){
+    auto & ls = list.ref();
+    auto keyword = ls.empty() ? std::nullopt : ls[0].get_if<ast::Symbol>();
+    if(keyword && !builtin_syntax.contains(*keyword)) keyword.reset();
+
+    ast::vector<ast::SExpr> out{};
+    auto keep = [&](std::size_t n){
+        for(std::size_t i = 0 ; i < n && i < ls.size() ; ++i) out.emplace_back(ls[i]);
+    };
+    auto resolve_rest = [&]{
+        for(std::size_t i = out.size() ; i < ls.size() ; ++i) out.emplace_back(resolve(global , scope , ls[i]));
+    };
+
+    if(!keyword) {
+        resolve_rest();
+    }else if(*keyword == "lambda"){
+        // malformed lambdas stay as they are , eval_lambda reports them
+        auto params = ls.size() == 3 ? ls[1].get_if<ast::List>() : nullptr;
+        if(!params || !std::ranges::all_of(params->ref() , [](auto & e){ return e.template holds<ast::Symbol>(); }))
+            return list;
+
+        ast::short_vector<ast::Symbol> names{};
+        for(auto & e : params->ref()) names.emplace_back(e.get<ast::Symbol>());
+        Scope inner{names , &scope};
+        auto body = resolve(global , inner , ls[2]);
+        return ast::LambdaForm{ast::LambdaCode{
+            .var_names = std::move(names) ,
+            .captures = std::move(inner.captures) ,
+            .body = std::move(body)
+        }};
+    }else if(*keyword == "define"){
+        keep(2);
+        resolve_rest();
+    }else if(*keyword == "cond"){
+        keep(1);
+        for(auto & e : subrange(ls.begin() + 1 , ls.end())){
+            auto clause = e.get_if<ast::List>();
+            if(!clause || clause->ref().empty() || clause->ref()[0] != ast::Symbol{"else"}) {
+                out.emplace_back(resolve(global , scope , e));
+                continue;
+            }
+            ast::vector<ast::SExpr> branch{clause->ref()[0]};
+            for(auto & v : subrange(clause->ref().begin() + 1 , clause->ref().end()))
+                branch.emplace_back(resolve(global , scope , v));
+            out.emplace_back(ast::List{std::move(branch)});
+        }
+    }else {
+        keep(1);
+        resolve_rest();
+    }
+    return ast::List{std::move(out)};
+}
+
+// rewrite the symbols of a lambda body to where they are bound ,
+// quoted data , keywords and the names being bound stay symbols.
+ast::SExpr resolve(Environment & global , Scope & scope , const ast::SExpr & sexpr){
+    if(auto name = sexpr.get_if<ast::Symbol>()) return resolve_symbol(global , &scope , *name);
+    if(auto list = sexpr.get_if<ast::List>()) return resolve_list(global , scope , *list);
+    return sexpr;
+}
+
+// values holds the evaluated callee followed by the arguments
+ast::SExpr invoke_function(ast::vector<ast::SExpr> & values , Tail & tail){
+    const auto & lambda = values[0].get<ast::Lambda>();
+    auto argc = values.size() - 1;
+    auto n_except = lambda.expected();
     // too many arguments
-    if(n_except < list->size() -1 )
+    if(n_except < argc)
         throw runtime_error(fmt::format(
             "argument size mismatch in {}, expect {} , got {} , ",
-            ast::print_sexpr(list) , n_except , list->size()));
+            ast::print_sexpr(ast::List{values}) , n_except , values.size()));
 
-    for(auto & e : subrange(list.ref().begin() + 1 , list.ref().end()))
-        lambda.bounded.mut().emplace_back(e);
-    
+    auto args = subrange(values.begin() + 1 , values.end());
     //currying 
-    if(lambda.var_names->size() > lambda.bounded->size()){
-        return lambda;
-    }
-    //invoke
-    else{
-        Environment tmp_env{};
-        for(auto & [k , v]: lambda.free_vars.ref()){
-            tmp_env.set(k , v);
-        }
-        for(std::size_t i = 0 ; i < lambda.var_names->size() ; ++i){
-            tmp_env.set(lambda.var_names.ref()[i] , lambda.bounded.ref()[i]);
-        }
-        auto auto_pop = cls.push(tmp_env);
-        Runtime::eval_sexpr(cls , lambda.body.mut());
-        return lambda.body.ref();
+    if(n_except > argc) return ast::curry(lambda , args);
+
+    // closures of the bytecode compiler ( builtin wrappers included ) run on the vm
+    if(lambda.code->compiled){
+        ast::vector<ast::SExpr> rest{};
+        for(auto & e : args) rest.emplace_back(std::move(e));
+        return Runtime::apply(std::move(values[0]) , std::move(rest));
     }
+
+    LISPY_COUNT(invocations);
+    LISPY_COUNT(environments);
+    ast::vector<ast::SExpr> slots{};
+    slots.reserve(lambda.code->var_names.size());
+    for(auto & e : lambda.bounded()) slots.emplace_back(e);
+    for(auto & e : args) slots.emplace_back(std::move(e));
+
+    //invoke , the body is shared with the lambda , not copied
+    auto & body = lambda.code->body;
+    tail.frame.emplace(Frame{
+        .slots = std::move(slots) ,
+        .closure = std::move(values[0])
+    });
+    return defer(tail , body);
 }
 
-ast::SExpr eval_list(Closure & cls , ast::List & list){
+ast::SExpr eval_list(Closure & cls , const ast::List & list , Tail & tail){
     if(list->size() == 0) 
         throw runtime_error("missing procedure expression , given emtpy ().");
 
@@ -168,27 +274,33 @@ ast::SExpr eval_list(Closure & cls , ast::List & list){
     {
         auto & head = * (list->begin());
         if(auto iden = head.get_if<ast::Symbol>() ; iden && builtin_syntax.contains(*iden)){
-            return builtin_syntax.at(*iden) (cls , list);
+            return builtin_syntax.at(*iden) (cls , list , tail);
         }
     }
     //2. procedure
-    //TODO : avoid list mut
-    for(auto & e : list.mut()) Runtime::eval_sexpr(cls ,e);
-    auto & head = * (list->begin());
+    ast::vector<ast::SExpr> values{};
+    for(auto & e : list.ref()) values.emplace_back(Runtime::eval_sexpr(cls , e));
+    auto & head = values[0];
     if(head.holds<ast::Lambda>()){
-        return invoke_function(cls ,list);
-    }else if(head.holds<ast::BuiltinFn>()) {
-        auto builtin = Runtime::get_builtin_func(head.get_if<ast::BuiltinFn>()->name);
-        return builtin(cls , list);
+        return invoke_function(values , tail);
+    }else if(auto builtin = head.get_if<ast::BuiltinFn>()) {
+        // partial applications curry , and report a wrong count , like any lambda
+        if(values.size() - 1 != builtin->arity){
+            values[0] = builtin_lambda(*builtin);
+            return invoke_function(values , tail);
+        }
+        LISPY_COUNT(builtin_calls);
+        auto fn = builtin->fn;
+        ast::List params{std::move(values)};
+        return fn(cls , params);
     }
     //3. false
     else 
         throw runtime_error(fmt::format(
             "not a procedure , given {} , \nin {}" , 
-            ast::print_sexpr(head),ast::print_sexpr(list))
+            ast::print_sexpr(head),ast::print_sexpr(ast::List{values}))
         );
 }
-
 }
 
 bool is_need_quote(const ast::SExpr & e ){
@@ -199,37 +311,110 @@ ast::SExpr Runtime::quote(ast::SExpr e){
     return is_need_quote(e) ? ast::SExpr{ast::Quote{std::move(e)}} : e;
 }
 
-void Runtime::eval_sexpr(Closure & cls , ast::SExpr & sexpr){
-    sexpr.match(overloaded{
-        [&] (ast::List & l)     { 
-            sexpr = eval_list(cls , l); 
-        },
-        [&] (ast::Symbol & name){   
-            if(auto v = cls.find(name) ; v) sexpr = *v;
-            else throw runtime_error(fmt::format("undefined {}" , name));
-        },
-        [&] (ast::Quote & q)    {
-            if(! is_need_quote(q.ref())) sexpr = q.ref();
-        },
-        []  (auto && _)         {   /* do nothing */},
-    });
-}
+ast::SExpr Runtime::eval_sexpr(Closure & cls , const ast::SExpr & sexpr){
+    depth_guard guard{};
+    // frame of the function entered by a tail call , later tail calls replace it
+    std::optional<Frame> frame{};
+    std::optional<Closure::frame_guard> entered{};
+
+    for(auto current = &sexpr ; ; ){
+        Tail tail{};
+        auto value = current->match<ast::SExpr>(overloaded{
+            [&] (const ast::List & l) { 
+                return eval_list(cls , l , tail); 
+            },
+            [&] (const ast::Symbol & name) -> ast::SExpr {   
+                if(auto v = cls.find(name) ; v) return std::move(*v);
+                throw runtime_error(fmt::format("undefined {}" , name));
+            },
+            [&] (const ast::LocalRef & ref) -> ast::SExpr {
+                return cls.local(ref.slot);
+            },
+            [&] (const ast::CaptureRef & ref) -> ast::SExpr {
+                return cls.capture(ref.index);
+            },
+            [&] (const ast::LambdaForm & form) -> ast::SExpr {
+                auto & refs = form.code->captures;
+                return ast::SExpr::lambda(form.code , refs.size() , 0 , [&](std::span<ast::SExpr> values){
+                    for(std::size_t i = 0 ; i < refs.size() ; ++i){
+                        auto local = refs[i].get_if<ast::LocalRef>();
+                        values[i] = local ? cls.local(local->slot) : cls.capture(refs[i].get<ast::CaptureRef>().index);
+                    }
+                });
+            },
+            [&] (const ast::GlobalRef & ref) -> ast::SExpr {
+                if(auto & v = cls.global().at(ref.slot) ; v) return *v;
+                throw runtime_error(fmt::format("undefined {}" , ref.name));
+            },
+            [&] (const ast::Quote & q) -> ast::SExpr {
+                return is_need_quote(q.ref()) ? *current : q.ref();
+            },
+            [&] (const auto & _) -> ast::SExpr { return *current; },
+        });
 
-std::optional<ast::SExpr> Closure::find(std::string_view name) noexcept{
-    for(Environment & env : _cls | reverse){
-        if(auto v = env.get(name) ; v) return v;
+        if(!tail.pending) return value;
+        current = tail.pending;
+        if(tail.frame){
+            if(!entered) entered.emplace(cls);
+            frame = std::move(tail.frame);
+            cls.set_frame(&*frame);
+        }
     }
-    return std::nullopt;
+}
+
+std::optional<ast::SExpr> Closure::find(ast::Symbol name) noexcept{
+    return _global.get(name);
 }
 
 std::string Runtime::eval(std::string_view input){
+    return eval(input , mode());
+}
+
+std::string Runtime::eval(std::string_view input , eval_mode mode){
+#ifndef LISPY_GC
+    // released after everything below , what define kept was promoted out of it
+    arena::scope form{instance()._arena};
+    // released before form , so no object of its arena is left waiting to be freed
+    struct drained{ ~drained() { ast::reclaim(); } } dropped{};
+#endif
     auto result = ast::parse(input);
     if(!result) throw parse_error("parse error.");
     auto & rt = Runtime::instance();
-    //TODO : exception safety
-    if(result->holds<ast::List>() || result->holds<ast::Symbol>() || result->holds<ast::Quote>())
-        Runtime::eval_sexpr(rt._cls , *result);
-    return print_sexpr(*result);
+    if(result->holds<ast::List>() || result->holds<ast::Symbol>() || result->holds<ast::Quote>()){
+        //TODO : exception safety
+        if(mode == eval_mode::tree_walk) *result = Runtime::eval_sexpr(rt._cls , *result);
+        // only the vm holds values while it runs a form , so its calls are safe points
+        else *result = rt._vm.run(*vm::compile(*result) , true);
+    }
+    auto printed = print_sexpr(*result);
+#ifdef LISPY_GC
+    // the form is done , only globals are left
+    if(gc::should_collect()) collect();
+#endif
+    return printed;
+}
+
+// holds one chunk and the unfinished form , however long the input
+std::size_t Runtime::load(int fd , const std::function<void(const std::string &)> & on_result){
+    ast::form_reader reader{};
+    std::vector<char> chunk(64 * 1024);
+    std::size_t forms = 0;
+    for(bool done = false ; !done ; ){
+        auto n = ::read(fd , chunk.data() , chunk.size());
+        if(n < 0 && errno == EINTR) continue;
+        if(n < 0) throw std::system_error(errno , std::generic_category() , "load");
+        if(n == 0){
+            reader.finish();
+            done = true;
+        }
+        reader.feed({chunk.data() , static_cast<std::size_t>(n)});
+        while(auto form = reader.next()){
+            auto result = eval(*form);
+            ++forms;
+            if(on_result) on_result(result);
+        }
+    }
+    return forms;
 }
 
-}
\ No newline at end of file
+}
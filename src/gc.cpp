@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <new>
+
+#include "gc.h"
+#include "vm.h"
+
+namespace lispy::gc {
+
+#ifdef LISPY_GC
+
+void * allocate(std::size_t bytes){
+    return heap::instance().allocate(bytes);
+}
+
+void tracer::mark(const ast::SExpr & e){
+    if(!e.is_object() || e.object()->marked) return;
+    e.object()->marked = true;
+    _pending.push_back(e.object());
+}
+
+void tracer::mark(const vm::Function & fn){
+    if(!_traced.insert(&fn).second) return;
+    for(auto & k : fn.constants) mark(k);
+    for(auto & code : fn.functions) mark(*code);
+}
+
+void tracer::mark(const ast::LambdaCode & code){
+    if(!_traced.insert(&code).second) return;
+    for(auto & c : code.captures) mark(c);
+    mark(code.body);
+    if(code.compiled) mark(*code.compiled);
+}
+
+void tracer::drain(){
+    while(!_pending.empty()){
+        auto o = _pending.back();
+        _pending.pop_back();
+        switch(o->type){
+        case ast::kind::quote :
+            mark(static_cast<const ast::Boxed<ast::Quote> *>(o)->value.value);
+            break;
+        case ast::kind::list :
+            for(auto & e : *static_cast<const ast::Boxed<ast::List> *>(o)->value._cells) mark(e);
+            break;
+        case ast::kind::lambda :{
+            auto & lambda = static_cast<const ast::Boxed<ast::Lambda> *>(o)->value;
+            for(auto & v : lambda.values()) mark(v);
+            mark(*lambda.code);
+            break;
+        }
+        case ast::kind::lambda_form :
+            mark(*static_cast<const ast::Boxed<ast::LambdaForm> *>(o)->value.code);
+            break;
+        default :
+            break;
+        }
+    }
+}
+
+heap::~heap(){
+    for(auto & r : _regions){
+        sweep(r);
+        ::operator delete(r.begin);
+    }
+    for(auto & r : _empty) ::operator delete(r.begin);
+}
+
+void * heap::allocate(std::size_t bytes){
+    if(!_current || _current->top + bytes > _current->end){
+        if(!refill(bytes)) throw std::bad_alloc{};
+    }
+    auto p = _current->top;
+    _current->top += bytes;
+    _allocated += bytes;
+    return p;
+}
+
+// the next region to bump from , an empty one when there is one that fits
+bool heap::refill(std::size_t bytes){
+    auto size = std::max(bytes , region_size);
+    auto it = std::find_if(_empty.begin() , _empty.end() , [&](const region & r){
+        return static_cast<std::size_t>(r.end - r.begin) >= bytes;
+    });
+    if(it != _empty.end()){
+        _regions.push_back(*it);
+        _empty.erase(it);
+    }else{
+        auto begin = static_cast<std::byte *>(::operator new(size , std::nothrow));
+        if(!begin) return false;
+        _regions.push_back(region{begin , begin , begin + size});
+    }
+    _current = &_regions.back();
+    return true;
+}
+
+bool heap::sweep(region & r) noexcept{
+    bool live = false;
+    for(auto p = r.begin ; p != r.top ; ){
+        auto o = reinterpret_cast<ast::Object *>(p);
+        p += o->size;
+        if(o->type == ast::kind::boolean) continue;
+        if(o->marked){
+            o->marked = false;
+            live = true;
+        }else{
+            ast::SExpr::destroy(o);
+            o->type = ast::kind::boolean;
+        }
+    }
+    return live;
+}
+
+void heap::collect(const roots & r){
+    tracer t{};
+    r(t);
+    root::trace(t);
+    t.drain();
+
+    _live = 0;
+    std::vector<region> kept{};
+    for(auto & reg : _regions){
+        if(sweep(reg)){
+            _live += reg.top - reg.begin;
+            kept.push_back(reg);
+        }else if(static_cast<std::size_t>(reg.end - reg.begin) > region_size){
+            // regions of a single large object go back to the system
+            ::operator delete(reg.begin);
+        }else{
+            reg.top = reg.begin;
+            _empty.push_back(reg);
+        }
+    }
+    _regions = std::move(kept);
+    // partly live regions are not bumped into again , the next allocation starts a region
+    _current = nullptr;
+    _allocated = 0;
+    _threshold = std::max(min_threshold , _live);
+    ++_collections;
+}
+
+heap_stats heap::stats() const noexcept{
+    return heap_stats{
+        .collections = _collections ,
+        .regions = _regions.size() + _empty.size() ,
+        .live_bytes = _live ,
+        .allocated = _allocated ,
+    };
+}
+
+void root::trace(tracer & t){
+    for(auto r = _first ; r ; r = r->_next) t.mark(r->_value);
+}
+
+#else
+
+void root::trace(tracer &) {}
+
+#endif
+
+}
@@ -17,14 +17,14 @@ struct default_format_parser{
 template<>
 struct fmt::formatter<ast::Quote> : default_format_parser{
     template<class Context >
-    auto format(const ast::Quote & q , Context & ctx){
+    auto format(const ast::Quote & q , Context & ctx) const {
         return format_to(ctx.out() , "'{}" , q.ref());
     }
 };
 template<>
 struct fmt::formatter<ast::List> : default_format_parser{
     template<class Context>
-    auto format(const ast::List & list , Context & ctx){
+    auto format(const ast::List & list , Context & ctx) const {
         return format_to(ctx.out() , "({})" , fmt::join(list->begin(), list->end() , " "));
     }
 };
@@ -32,7 +32,7 @@ struct fmt::formatter<ast::List> : default_format_parser{
 template<>
 struct fmt::formatter<ast::Lambda> : default_format_parser{
     template<class Context>
-    auto format(const ast::Lambda & f , Context & ctx){
+    auto format(const ast::Lambda & f , Context & ctx) const {
         return format_to(ctx.out() , "#<procedure>");
     }
 };
@@ -40,15 +40,48 @@ struct fmt::formatter<ast::Lambda> : default_format_parser{
 template<>
 struct fmt::formatter<ast::BuiltinFn> : default_format_parser{
     template<class Context>
-    auto format(const ast::BuiltinFn & f , Context & ctx){
+    auto format(const ast::BuiltinFn & f , Context & ctx) const {
         return format_to(ctx.out() , "#<builtin :{}>" , f.name);
     }
 };
 
+template<>
+struct fmt::formatter<ast::LocalRef> : default_format_parser{
+    template<class Context>
+    auto format(const ast::LocalRef & r , Context & ctx) const {
+        return format_to(ctx.out() , "{}" , r.name);
+    }
+};
+
+template<>
+struct fmt::formatter<ast::CaptureRef> : default_format_parser{
+    template<class Context>
+    auto format(const ast::CaptureRef & r , Context & ctx) const {
+        return format_to(ctx.out() , "{}" , r.name);
+    }
+};
+
+template<>
+struct fmt::formatter<ast::LambdaForm> : default_format_parser{
+    template<class Context>
+    auto format(const ast::LambdaForm & f , Context & ctx) const {
+        auto & code = *f.code;
+        return format_to(ctx.out() , "(lambda ({}) {})" , fmt::join(code.var_names.begin() , code.var_names.end() , " ") , code.body);
+    }
+};
+
+template<>
+struct fmt::formatter<ast::GlobalRef> : default_format_parser{
+    template<class Context>
+    auto format(const ast::GlobalRef & r , Context & ctx) const {
+        return format_to(ctx.out() , "{}" , r.name);
+    }
+};
+
 template<>
 struct fmt::formatter<ast::SExpr> : default_format_parser{
     template<class Context>
-    auto format (const ast::SExpr & s , Context & ctx){
+    auto format (const ast::SExpr & s , Context & ctx) const {
         using RetIt = decltype(ctx.out());
         return s.match<RetIt>([&](auto && e) mutable{
             return format_to(ctx.out() , "{}" , e);
@@ -0,0 +1,55 @@
+#include "reader.h"
+
+namespace lispy::ast {
+
+namespace {
+
+bool is_space(char c) noexcept { return c == ' ' || c == '\n' || c == '\t'; }
+
+}
+
+// the returned forms go , so the buffer only grows with the unfinished one
+void form_reader::feed(std::string_view chunk){
+    _buf.erase(0 , _begin);
+    _pos -= _begin;
+    if(_start != npos) _start -= _begin;
+    _begin = 0;
+    _buf.append(chunk);
+}
+
+std::optional<std::string_view> form_reader::next(){
+    auto form = [&](std::size_t end){
+        std::string_view f{_buf.data() + _start , end - _start};
+        _begin = _pos = end;
+        _start = npos;
+        _atom = false;
+        return f;
+    };
+    for(; _pos < _buf.size() ; ++_pos){
+        auto c = _buf[_pos];
+        if(_start == npos){
+            if(is_space(c)){
+                _begin = _pos + 1;
+                continue;
+            }
+            _start = _pos;
+        }
+        if(_atom){
+            if(is_space(c) || c == '(' || c == ')' || c == '\'') return form(_pos);
+        }else if(c == '('){
+            ++_depth;
+        }else if(c == ')'){
+            // a stray ')' is a form of its own , which parse rejects
+            if(_depth == 0 || --_depth == 0) return form(_pos + 1);
+        }else if(_depth == 0 && c != '\'' && !is_space(c)){
+            _atom = true;
+        }
+    }
+    if(_finished && _start != npos){
+        _depth = 0;
+        return form(_buf.size());
+    }
+    return std::nullopt;
+}
+
+}
@@ -12,7 +12,7 @@ using std::ranges::subrange;
 
 namespace{
 
-using ExprList = cexpr::vector<ast::SExpr> ;
+using ExprList = ast::vector<ast::SExpr> ;
 
 template<class T> 
 const char * name () {
@@ -46,13 +46,9 @@ const ast::SExpr & get_param(std::size_t n , ast::List & params){
     return params.ref()[n+1];
 }
 
-ast::SExpr & get_param_mut(std::size_t n , ast::List & params){
-    return params.mut()[n+1];
-}
-
 template<class T>
 decltype(auto) get_param_unsafe_cast(std::size_t n , ast::List &params){
-    return * (params.ref()[n + 1].get_if<T>());
+    return params.ref()[n + 1].template get<T>();
 }
 decltype(auto) get_quote_list_unsafe(std::size_t n , ast::List &params){
     return * get_param_unsafe_cast<ast::Quote>(n , params).ref().get_if<ast::List>();
@@ -127,11 +123,7 @@ ast::SExpr builtin_cdr(Closure & cls , ast::List & params){
         throw type_error{fmt::format("cdr : contract fail , list is empty , in {}" , ast::print_sexpr(get_param(0,params)))};
     }
 
-    cexpr::vector<ast::SExpr> ls{};
-    for(auto & v : subrange(quote_list.ref().begin() + 1 , quote_list.ref().end()))
-        ls.emplace_back(v);
-
-    return ast::Quote{ast::List{std::move(ls)}};
+    return ast::Quote{quote_list.cdr()};
 }
 
 ast::SExpr builtin_cons(Closure & cls , ast::List & params){
@@ -142,10 +134,8 @@ ast::SExpr builtin_cons(Closure & cls , ast::List & params){
     auto & lhs = get_param(0 , params);
     auto & rhs = get_quote_list_unsafe(1 , params);
 
-    ast::List result{ExprList{lhs.holds<ast::Quote>() ? lhs.get_if<ast::Quote>()->ref() : lhs}};
-    for(auto & v : rhs.ref())
-        result.mut().emplace_back(v);
-    return ast::Quote{std::move(result)};
+    auto car = lhs.holds<ast::Quote>() ? lhs.get_if<ast::Quote>()->ref() : lhs;
+    return ast::Quote{ast::List::cons(std::move(car) , rhs)};
 }
 
 ast::SExpr builtin_eq(Closure & cls , ast::List & params){
@@ -249,8 +239,29 @@ ast::SExpr builtin_eval(Closure & cls , ast::List & params){
     auto & p = get_param(0 , params);
     auto sexpr = p.holds<ast::Quote>()? p.get_if<ast::Quote>()->ref() : p;
 
-    Runtime::eval_sexpr(cls , sexpr);
-    return sexpr;
+    if(Runtime::mode() == eval_mode::bytecode) 
+        return Runtime::execute(sexpr);
+    // evaluated at top level , whatever frame the caller runs in
+    Closure top{cls.global()};
+    return Runtime::eval_sexpr(top , sexpr);
+}
+
+// ((cow-allocs n) (cow-clones n) ...)
+ast::SExpr builtin_runtime_stats(Closure & cls , ast::List & params){
+    schemer(params , 0);
+    auto stats = Runtime::stats();
+    std::pair<std::string_view , std::size_t> fields[]{
+        {"cow-allocs" , stats.cow_allocs} ,
+        {"cow-clones" , stats.cow_clones} ,
+        {"vector-grows" , stats.vector_grows} ,
+        {"environments" , stats.environments} ,
+        {"invocations" , stats.invocations} ,
+        {"builtin-calls" , stats.builtin_calls} ,
+    };
+    ExprList entries{};
+    for(auto [name , n] : fields)
+        entries.emplace_back(ast::List{ExprList{ast::Symbol{name} , static_cast<ast::Integer>(n)}});
+    return Runtime::quote(ast::List{std::move(entries)});
 }
 
 std::string_view builtin_var_name(std::size_t n){
@@ -262,21 +273,146 @@ std::string_view builtin_var_name(std::size_t n){
     return var_names[n];
 }
 
-ast::Lambda make_builtin_lambda(std::string_view name , std::size_t n_bound_vars){
-    ast::List body = cexpr::vector<ast::SExpr>{ast::BuiltinFn{name}};
-    cexpr::vector<std::string_view> vars{};
+ast::SExpr make_builtin_lambda(const ast::BuiltinFn & fn){
+    ast::vector<ast::SExpr> body{fn};
+    ast::LambdaCode code{};
 
-    for(std::size_t i = 0 ; i < n_bound_vars ; ++i){
+    for(std::size_t i = 0 ; i < fn.arity ; ++i){
         auto var_name = builtin_var_name(i);
-        body.mut().emplace_back(ast::Symbol{var_name});
-        vars.emplace_back(var_name);
+        body.emplace_back(ast::Symbol{var_name});
+        code.var_names.emplace_back(var_name);
     }
-    return ast::Lambda {
-        .var_names = std::move(vars),
-        .body = ast::SExpr{body},
-    };
+    code.body = ast::List{std::move(body)};
+    code.compiled = vm::compile(code);
+    return ast::SExpr::lambda(std::move(code));
+}
+
+}
+
+ast::SExpr lispy::builtin_lambda(const ast::BuiltinFn & fn){
+    static std::unordered_map<std::string_view , gc::root> lambdas{};
+    auto it = lambdas.find(fn.name);
+    if(it == lambdas.end()){
+        arena::pause cached{};
+        it = lambdas.try_emplace(fn.name , make_builtin_lambda(fn)).first;
+    }
+    return *it->second;
+}
+
+namespace {
+
+struct promoter{
+    // the arena of the running form , what it did not allocate is shared as is
+    const arena * form{arena::current()};
+    arena::pause heap{};
+    // code shared by several closures stays shared
+    std::unordered_map<const ast::LambdaCode * , ast::cow<ast::LambdaCode>> codes{};
+
+    template<class T , std::size_t N>
+    ast::vector<T , N> vector(const ast::vector<T , N> & v){
+        ast::vector<T , N> copy{};
+        copy.reserve(v.size());
+        for(auto & e : v) copy.emplace_back(element(e));
+        return copy;
+    }
+
+    ast::Symbol element(const ast::Symbol & s){ return s; }
+    ast::SExpr element(const ast::SExpr & e){ return sexpr(e); }
+
+    vm::FunctionPtr function(const vm::FunctionPtr & fn){
+        if(!fn) return fn;
+        auto copy = std::make_shared<vm::Function>(vm::Function{
+            .code = fn->code ,
+            .globals = fn->globals ,
+            .captures = fn->captures ,
+            .failures = fn->failures ,
+        });
+        for(auto & site : copy->globals){
+            site.value = nullptr;
+            site.version = 0;
+        }
+        for(auto & k : fn->constants) copy->constants.push_back(sexpr(k));
+        for(auto & c : fn->functions) copy->functions.push_back(code(c));
+        return copy;
+    }
+
+    ast::cow<ast::LambdaCode> code(const ast::cow<ast::LambdaCode> & c){
+        if(!form || !form->owns(&c.ref())) return c;
+        if(auto it = codes.find(&c.ref()) ; it != codes.end()) return it->second;
+        ast::cow<ast::LambdaCode> copy{ast::LambdaCode{
+            .var_names = vector(c->var_names) ,
+            .captures = vector(c->captures) ,
+            .body = sexpr(c->body) ,
+            .compiled = function(c->compiled) ,
+        }};
+        codes.emplace(&c.ref() , copy);
+        return copy;
+    }
+
+    ast::SExpr sexpr(const ast::SExpr & e){
+        // allocated before the form or outside its arena , nothing it holds is in the arena either
+        if(!form || !e.allocated_in(*form)) return e;
+        return e.match<ast::SExpr>(overloaded{
+            [&](const ast::Quote & q) -> ast::SExpr { return ast::Quote{sexpr(q.ref())}; },
+            [&](const ast::List & l) -> ast::SExpr {
+                // storage from outside the arena holds no element from inside , see List::cons
+                if(!l.stored_in(*form)) return l;
+                ast::vector<ast::SExpr> elements{};
+                elements.reserve(l.size());
+                for(auto & x : l) elements.emplace_back(sexpr(x));
+                return ast::List{std::move(elements)};
+            },
+            [&](const ast::Lambda & f) -> ast::SExpr {
+                return ast::SExpr::lambda(code(f.code) , f.n_captures , f.n_bounded , [&](std::span<ast::SExpr> values){
+                    for(std::size_t i = 0 ; i < values.size() ; ++i) values[i] = sexpr(f.values()[i]);
+                });
+            },
+            [&](const ast::LambdaForm & f) -> ast::SExpr { return ast::LambdaForm{code(f.code)}; },
+            // the other alternatives own no memory besides their Object , copied out of the arena
+            [](const auto & value) -> ast::SExpr { return value; },
+        });
+    }
+};
+
 }
 
+ast::SExpr lispy::promote(const ast::SExpr & sexpr){
+    return promoter{}.sexpr(sexpr);
+}
+
+// roots are the globals and the vm , builtin_lambda keeps its cache in gc::root
+void Runtime::collect([[maybe_unused]] const vm::Function * running){
+#ifdef LISPY_GC
+    auto & rt = instance();
+    gc::heap::instance().collect([&](gc::tracer & t){
+        rt._global.trace(t);
+        rt._vm.trace(t , running);
+    });
+#endif
+}
+
+runtime_stats Runtime::stats() noexcept{
+    runtime_stats stats{};
+#ifdef CEXPR_STATS
+    stats.cow_allocs = cexpr::counters.cow_allocs;
+    stats.cow_clones = cexpr::counters.cow_clones;
+    stats.vector_grows = cexpr::counters.vector_grows;
+#endif
+#ifdef LISPY_STATS
+    stats.environments = counters.environments;
+    stats.invocations = counters.invocations;
+    stats.builtin_calls = counters.builtin_calls;
+#endif
+    return stats;
+}
+
+void Runtime::reset_stats() noexcept{
+#ifdef CEXPR_STATS
+    cexpr::counters = {};
+#endif
+#ifdef LISPY_STATS
+    counters = {};
+#endif
 }
 
 Runtime::Runtime() : _cls(_global) {
@@ -285,8 +421,7 @@ Runtime::Runtime() : _cls(_global) {
 
 void Runtime::init_builtins(){
     auto add_builtin = [&](std::string_view name ,Runtime::builtin_func f , std::size_t n){
-        this->_builtin_functions[name] = f;
-        this->_global.set(name , make_builtin_lambda(name , n));
+        this->_global.set(name , ast::BuiltinFn{name , f , n});
     };
 
     add_builtin("eval", builtin_eval, 1);
@@ -303,6 +438,8 @@ void Runtime::init_builtins(){
     add_builtin("add1" , builtin_add1,1);
     add_builtin("sub1" , builtin_sub1,1);
 
+    add_builtin("runtime-stats" , builtin_runtime_stats , 0);
+
     //set value
-    _global.set("nil" , ast::List{cexpr::vector<ast::SExpr>{}});
+    _global.set("nil" , ast::List{ast::vector<ast::SExpr>{}});
 }
\ No newline at end of file
@@ -1,10 +1,13 @@
+#include <array>
 #include <variant>
 #include <optional>
 #include <numeric>
+#include <vector>
 
 #include "parsec.h"
 #include "ast.h"
 #include "lispy.h"
+#include "structural.h"
 
 using namespace pscpp;
 using namespace lispy;
@@ -12,10 +15,14 @@ using namespace lispy;
 namespace {
 
 ast::SExpr from_symbol(std::string_view s){
-    return s;
+    return ast::Symbol{s};
 }
 ast::SExpr from_list(cexpr::vector<ast::SExpr> &&list){
-    return ast::List{std::move(list)};
+    // sepby collects on the heap , the list itself lives with the other values
+    ast::vector<ast::SExpr> elements{};
+    elements.reserve(list.size());
+    for(auto & e : list) elements.emplace_back(std::move(e));
+    return ast::List{std::move(elements)};
 }
 ast::SExpr from_quote(ast::SExpr s){
     return ast::Quote{s};
@@ -24,10 +31,11 @@ ast::SExpr from_boolean(char b){
     return ast::Boolean{b == 't'};
 }
 ast::SExpr from_integer(std::optional<char> neg , std::string_view nums){
+    // unsigned , so literals out of range wrap around instead of overflowing
     auto ints = std::accumulate(
-        nums.begin() , nums.end(), ast::Integer{0} , 
-        [](ast::Integer init , char i ){return init * 10 + ( i - '0');});
-    return neg? -ints : ints;
+        nums.begin() , nums.end(), uint64_t{0} , 
+        [](uint64_t init , char i ){return init * 10 + ( i - '0');});
+    return ast::SExpr{static_cast<ast::Integer>(neg ? 0 - ints : ints)};
 }
 
 /*                                                    
@@ -55,11 +63,217 @@ auto sexpr(std::string_view str) -> parser_result<ast::SExpr>{
     return sexpr_impl(str);
 }
 
+// the grammar above in a single pass over the input , classifying each byte by table.
+// open lists wait on an explicit stack , so nesting depth never shows on the native stack.
+enum : uint8_t { space = 1 , digit_ = 2 , symbol_ = 4 , structural_ = 8 };
+constexpr auto classes = [] {
+    std::array<uint8_t , 256> table{};
+    for(unsigned char c : std::string_view{" \n\t"}) table[c] = space;
+    for(int c = '0' ; c <= '9' ; ++c) table[c] = digit_ | symbol_;
+    for(int c = 'a' ; c <= 'z' ; ++c) table[c] = table[c - 'a' + 'A'] = symbol_;
+    for(unsigned char c : std::string_view{"_+-*/\\=<>!?&"}) table[c] = symbol_;
+    for(unsigned char c : std::string_view{"()'"}) table[c] = structural_;
+    return table;
+}();
+
+bool is(std::string_view in , std::size_t pos , uint8_t cls) noexcept {
+    return pos < in.size() && (classes[static_cast<unsigned char>(in[pos])] & cls);
+}
+
+// literal | symbol at pos , moving pos past it.
+// the first alternative that matches wins however much follows it
+std::optional<ast::SExpr> read_atom(std::string_view in , std::size_t & pos){
+    if(pos + 1 < in.size() && in[pos] == '#' && (in[pos + 1] == 't' || in[pos + 1] == 'f')){
+        pos += 2;
+        return ast::SExpr{ast::Boolean{in[pos - 1] == 't'}};
+    }
+    bool negative = pos < in.size() && in[pos] == '-';
+    if(is(in , pos + negative , digit_)){
+        // wraps around like the integer of the grammar
+        uint64_t value = 0;
+        for(pos += negative ; is(in , pos , digit_) ; ++pos) value = value * 10 + (in[pos] - '0');
+        return ast::SExpr{static_cast<ast::Integer>(negative ? 0 - value : value)};
+    }
+    auto from = pos;
+    while(is(in , pos , symbol_)) ++pos;
+    if(pos == from) return std::nullopt;
+    return ast::SExpr{ast::Symbol{in.substr(from , pos - from)}};
+}
+
+ast::SExpr quoted(ast::SExpr value , std::size_t quotes){
+    for(; quotes > 0 ; --quotes) value = ast::Quote{std::move(value)};
+    return value;
+}
+
+// the lists a reader has not seen the ')' of yet
+class open_lists{
+    struct open_list{
+        ast::vector<ast::SExpr> elements{};
+        std::size_t quotes;     // before its '('
+    };
+    std::vector<open_list> _open{};
+
+public:
+    bool empty() const noexcept { return _open.empty(); }
+    void open(std::size_t quotes) { _open.push_back(open_list{.quotes = quotes}); }
+    void add(ast::SExpr e) { _open.back().elements.push_back(std::move(e)); }
+    // the innermost list , quoted as it was
+    ast::SExpr close(){
+        auto value = quoted(ast::List{std::move(_open.back().elements)} , _open.back().quotes);
+        _open.pop_back();
+        return value;
+    }
+};
+
+class reader{
+    std::string_view _in;
+    std::size_t _pos{0};
+    open_lists _open{};
+
+    std::size_t skip_spaces() noexcept {
+        auto from = _pos;
+        while(is(_in , _pos , space)) ++_pos;
+        return _pos - from;
+    }
+    bool at(char c) const noexcept { return _pos < _in.size() && _in[_pos] == c; }
+
+public:
+    explicit reader(std::string_view in) noexcept : _in(in) {}
+
+    std::optional<ast::SExpr> read(){
+        skip_spaces();
+        std::size_t quotes = 0;
+        for(;;){
+            // the start of an element
+            if(at('\'')){
+                ++quotes;   ++_pos;
+                continue;
+            }
+            std::optional<ast::SExpr> value{};
+            if(at('(')){
+                ++_pos;
+                _open.open(std::exchange(quotes , 0));
+                skip_spaces();
+                if(!at(')')) continue;
+            }else if(value = read_atom(_in , _pos) ; !value){
+                return std::nullopt;
+            }else{
+                value = quoted(std::move(*value) , std::exchange(quotes , 0));
+            }
+            // the element is done , and so is every list it closes
+            for(;;){
+                if(!value){
+                    // at the ')' of the innermost list
+                    ++_pos;
+                    value = _open.close();
+                }
+                if(_open.empty()){
+                    skip_spaces();
+                    if(_pos != _in.size()) return std::nullopt;
+                    return value;
+                }
+                _open.add(std::move(*value));
+                value.reset();
+                auto spaces = skip_spaces();
+                if(at(')')) continue;
+                if(spaces == 0) return std::nullopt;
+                break;
+            }
+        }
+    }
+};
+
+// reader walking the tokens of a structural::indexer , whitespace is whatever lies between them.
+// an atom ends where read_atom stops , a byte that is neither whitespace nor structural there is an error
+class indexed_reader{
+    static constexpr auto npos = std::string_view::npos;
+
+    std::string_view _in;
+    structural::indexer _index;
+    std::vector<uint32_t> _tokens{};
+    std::size_t _next{0};
+    open_lists _open{};
+
+    // position of the next token , npos once there is none
+    std::size_t peek(){
+        while(_next == _tokens.size()){
+            if(!_index.next(_tokens)) return npos;
+            _next = 0;
+        }
+        return _tokens[_next];
+    }
+
+public:
+    indexed_reader(std::string_view in , structural::isa with) noexcept : _in(in) , _index(in , with) {}
+
+    std::optional<ast::SExpr> read(){
+        std::size_t quotes = 0;
+        auto pos = peek();
+        for(;;){
+            // the start of an element , at the token pos
+            if(pos == npos) return std::nullopt;
+            ++_next;
+            std::optional<ast::SExpr> value{};
+            std::size_t end = pos + 1;
+            switch(_in[pos]){
+            case '\'' :
+                // what is quoted follows right away
+                ++quotes;
+                if(peek() != end) return std::nullopt;
+                pos = end;
+                continue;
+            case '(' :
+                _open.open(std::exchange(quotes , 0));
+                pos = peek();
+                if(pos == npos || _in[pos] != ')') continue;
+                break;
+            case ')' :
+                return std::nullopt;
+            default :
+                end = pos;
+                value = read_atom(_in , end);
+                if(!value || (end < _in.size() && !is(_in , end , space | structural_))) return std::nullopt;
+                value = quoted(std::move(*value) , std::exchange(quotes , 0));
+            }
+            // the element is done , and so is every list it closes
+            for(;;){
+                if(!value){
+                    // the next token is the ')' of the innermost list
+                    end = peek() + 1;
+                    ++_next;
+                    value = _open.close();
+                }
+                if(_open.empty()){
+                    if(peek() != npos) return std::nullopt;
+                    return value;
+                }
+                _open.add(std::move(*value));
+                value.reset();
+                pos = peek();
+                if(pos == npos) return std::nullopt;
+                if(_in[pos] == ')') continue;
+                // elements are apart
+                if(pos == end) return std::nullopt;
+                break;
+            }
+        }
+    }
+};
+
 }
 
 namespace lispy{
 
+std::optional<ast::SExpr> structural::parse(std::string_view input , isa with){
+    if(input.size() > indexer::max_input) return ast::parse(input);
+    return indexed_reader{input , with}.read();
+}
+
 std::optional<ast::SExpr> ast::parse(std::string_view input) {
+    return reader{input}.read();
+}
+
+std::optional<ast::SExpr> ast::parse_combinators(std::string_view input) {
     auto result = lispy_(input);
     return result? std::optional{result->first} : std::nullopt ;
 }
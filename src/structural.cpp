@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LISPY_X86 1
+#endif
+
+#include "structural.h"
+
+namespace lispy::structural {
+
+namespace {
+
+// bit i for byte i of a block of 64
+struct block{
+    uint64_t structural{0};     // ( ) '
+    uint64_t atom{0};           // neither structural nor whitespace
+};
+
+using classify_fn = block (*)(const char *) noexcept;
+
+block classify_scalar(const char * p) noexcept{
+    block b{};
+    for(int i = 0 ; i < 64 ; ++i){
+        auto c = p[i];
+        auto bit = uint64_t{1} << i;
+        if(c == '(' || c == ')' || c == '\'') b.structural |= bit;
+        else if(c != ' ' && c != '\n' && c != '\t') b.atom |= bit;
+    }
+    return b;
+}
+
+#ifdef LISPY_X86
+
+__attribute__((target("sse2")))
+block classify_sse2(const char * p) noexcept{
+    block b{};
+    for(int i = 0 ; i < 4 ; ++i){
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * i));
+        auto st = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v , _mm_set1_epi8('(')) , _mm_cmpeq_epi8(v , _mm_set1_epi8(')'))) ,
+            _mm_cmpeq_epi8(v , _mm_set1_epi8('\'')));
+        auto ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v , _mm_set1_epi8(' ')) , _mm_cmpeq_epi8(v , _mm_set1_epi8('\n'))) ,
+            _mm_cmpeq_epi8(v , _mm_set1_epi8('\t')));
+        auto structural = static_cast<uint16_t>(_mm_movemask_epi8(st));
+        auto other = static_cast<uint16_t>(_mm_movemask_epi8(_mm_or_si128(st , ws)));
+        b.structural |= uint64_t{structural} << (16 * i);
+        b.atom |= uint64_t{static_cast<uint16_t>(~other)} << (16 * i);
+    }
+    return b;
+}
+
+__attribute__((target("avx2")))
+block classify_avx2(const char * p) noexcept{
+    block b{};
+    for(int i = 0 ; i < 2 ; ++i){
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32 * i));
+        auto st = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v , _mm256_set1_epi8('(')) , _mm256_cmpeq_epi8(v , _mm256_set1_epi8(')'))) ,
+            _mm256_cmpeq_epi8(v , _mm256_set1_epi8('\'')));
+        auto ws = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v , _mm256_set1_epi8(' ')) , _mm256_cmpeq_epi8(v , _mm256_set1_epi8('\n'))) ,
+            _mm256_cmpeq_epi8(v , _mm256_set1_epi8('\t')));
+        auto structural = static_cast<uint32_t>(_mm256_movemask_epi8(st));
+        auto other = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(st , ws)));
+        b.structural |= uint64_t{structural} << (32 * i);
+        b.atom |= uint64_t{~other} << (32 * i);
+    }
+    return b;
+}
+
+#endif
+
+// an instruction set the build has no code for runs as scalar
+classify_fn classifier(isa with) noexcept{
+#ifdef LISPY_X86
+    switch(with){
+    case isa::avx2 : return classify_avx2;
+    case isa::sse2 : return classify_sse2;
+    case isa::scalar : break;
+    }
+#endif
+    return classify_scalar;
+}
+
+}
+
+isa detect() noexcept{
+#ifdef LISPY_X86
+    static const isa best = __builtin_cpu_supports("avx2") ? isa::avx2
+                          : __builtin_cpu_supports("sse2") ? isa::sse2 : isa::scalar;
+    return best;
+#else
+    return isa::scalar;
+#endif
+}
+
+bool indexer::next(std::vector<uint32_t> & out){
+    out.clear();
+    if(_pos >= _in.size()) return false;
+    auto classify = classifier(_isa);
+    auto end = std::min(_in.size() , _pos + chunk);
+    for(auto pos = _pos ; pos < end ; pos += 64){
+        block b{};
+        if(end - pos >= 64){
+            b = classify(_in.data() + pos);
+        }else{
+            // the tail of the input , padded with whitespace
+            char padded[64];
+            std::memset(padded , ' ' , sizeof padded);
+            std::memcpy(padded , _in.data() + pos , end - pos);
+            b = classify(padded);
+        }
+        auto starts = b.atom & ~((b.atom << 1) | uint64_t{_in_atom});
+        _in_atom = b.atom >> 63;
+        for(auto bits = b.structural | starts ; bits ; bits &= bits - 1)
+            out.push_back(static_cast<uint32_t>(pos + std::countr_zero(bits)));
+    }
+    _pos = end;
+    return true;
+}
+
+}
@@ -0,0 +1,31 @@
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+#include "ast.h"
+
+namespace lispy {
+
+namespace {
+
+struct name_hash{
+    using is_transparent = void;
+    std::size_t operator()(std::string_view s) const noexcept { return std::hash<std::string_view>{}(s); }
+};
+
+// node based , the interned strings never move
+std::unordered_set<std::string , name_hash , std::equal_to<>> & intern_table(){
+    static std::unordered_set<std::string , name_hash , std::equal_to<>> table{};
+    return table;
+}
+
+}
+
+ast::Symbol::Symbol(std::string_view name){
+    auto & table = intern_table();
+    auto it = table.find(name);
+    if(it == table.end()) it = table.emplace(name).first;
+    _name = &*it;
+}
+
+}
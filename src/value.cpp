@@ -0,0 +1,102 @@
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "ast.h"
+
+namespace lispy {
+
+namespace {
+
+template<class T>
+void destroy_boxed(const ast::Object * o , [[maybe_unused]] std::size_t units = 1) noexcept{
+    auto p = const_cast<ast::Boxed<T> *>(static_cast<const ast::Boxed<T> *>(o));
+    std::destroy_at(p);
+#ifndef LISPY_GC
+    arena_allocator<ast::Boxed<T>>{}.deallocate(p , units);
+#endif
+}
+
+// objects whose count dropped to zero , waiting to be destroyed.
+// destructors only queue what they drop , the outermost destroy frees it in a loop ,
+// so how deep a value nests never shows on the native stack.
+struct reclaimer{
+    std::vector<const ast::Object *> pending{};
+    std::size_t slice{std::numeric_limits<std::size_t>::max()};
+    bool draining{false};
+
+    ~reclaimer() {
+        drain(std::numeric_limits<std::size_t>::max());
+        gone = true;
+    }
+
+    std::size_t drain(std::size_t budget) noexcept{
+        if(draining) return pending.size();
+        draining = true;
+        for(; budget > 0 && !pending.empty() ; --budget){
+            auto o = pending.back();
+            pending.pop_back();
+            destroy_now(o);
+        }
+        draining = false;
+        return pending.size();
+    }
+
+    static void destroy_now(const ast::Object * o) noexcept;
+    // set once the reclaimer of the thread is destroyed , static values dropped later free directly
+    static thread_local inline bool gone{false};
+};
+
+thread_local reclaimer deferred{};
+
+}
+
+void ast::SExpr::destroy(const Object * o) noexcept{
+#ifdef LISPY_GC
+    reclaimer::destroy_now(o);
+#else
+    if(reclaimer::gone) return reclaimer::destroy_now(o);
+    try{
+        deferred.pending.push_back(o);
+    }catch(...){
+        // no room to queue it , recursing is all that is left
+        return reclaimer::destroy_now(o);
+    }
+    deferred.drain(deferred.slice);
+#endif
+}
+
+std::size_t ast::reclaim(std::size_t budget) noexcept{
+    return deferred.drain(budget);
+}
+
+std::size_t ast::free_slice() noexcept{
+    return deferred.slice;
+}
+
+void ast::set_free_slice(std::size_t n) noexcept{
+    deferred.slice = std::max<std::size_t>(n , 1);
+}
+
+void reclaimer::destroy_now(const ast::Object * o) noexcept{
+    using namespace ast;
+    switch(o->type){
+    case kind::integer     : return destroy_boxed<Integer>(o);
+    case kind::quote       : return destroy_boxed<Quote>(o);
+    case kind::list        : return destroy_boxed<List>(o);
+    case kind::lambda      : {
+        auto & lambda = static_cast<const Boxed<Lambda> *>(o)->value;
+        return destroy_boxed<Lambda>(o , lambda_units(lambda.values().size()));
+    }
+    case kind::builtin     : return destroy_boxed<BuiltinFn>(o);
+    case kind::local_ref   : return destroy_boxed<LocalRef>(o);
+    case kind::capture_ref : return destroy_boxed<CaptureRef>(o);
+    case kind::global_ref  : return destroy_boxed<GlobalRef>(o);
+    case kind::lambda_form : return destroy_boxed<LambdaForm>(o);
+    // immediates are never on the heap
+    case kind::boolean :
+    case kind::symbol  : return;
+    }
+}
+
+}
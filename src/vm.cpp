@@ -0,0 +1,281 @@
+#include <ranges>
+#include <fmt/format.h>
+
+#include "ast.h"
+#include "gc.h"
+#include "lispy.h"
+#include "runtime.h"
+#include "vm.h"
+
+namespace lispy::vm {
+
+namespace {
+
+ast::List call_list(std::vector<ast::SExpr>::iterator first , std::vector<ast::SExpr>::iterator last){
+    ast::vector<ast::SExpr> ls{};
+    for(auto it = first ; it != last ; ++it) ls.emplace_back(*it);
+    return ast::List{std::move(ls)};
+}
+
+}
+
+ast::SExpr Machine::run(const Function & fn , bool safe_points){
+    auto bottom = _stack.size();
+    auto frames = _frames.size();
+    try{
+        // a top-level form has no closure , keep its slot so tail calls can take it over
+        _stack.emplace_back(ast::Boolean{false});
+        auto result = execute(fn , bottom + 1 , safe_points);
+        _stack.erase(_stack.begin() + bottom , _stack.end());
+        return result;
+    }catch(...){
+        unwind(bottom , frames);
+        throw;
+    }
+}
+
+ast::SExpr Machine::apply(ast::SExpr f , ast::vector<ast::SExpr> args){
+    auto bottom = _stack.size();
+    auto frames = _frames.size();
+    try{
+        _stack.push_back(std::move(f));
+        for(auto & e : args) _stack.push_back(std::move(e));
+        auto code = enter(args.size());
+        auto result = code ? execute(*code , bottom + 1 , false) : std::move(_stack.back());
+        _stack.erase(_stack.begin() + bottom , _stack.end());
+        return result;
+    }catch(...){
+        unwind(bottom , frames);
+        throw;
+    }
+}
+
+void Machine::unwind(std::size_t stack , std::size_t frames) noexcept{
+    _stack.erase(_stack.begin() + stack , _stack.end());
+    _frames.erase(_frames.begin() + frames , _frames.end());
+}
+
+// locals of the running frame live at _stack[base , base + n_params) ,
+// the closure being run right below them at _stack[base - 1].
+// callers wait in _frames , so scheme recursion never grows the native stack.
+ast::SExpr Machine::execute(const Function & entry , std::size_t base , bool safe_points){
+    const auto bottom = _frames.size();
+    const Function * fn = &entry;
+    const uint8_t * ip = fn->code.data();
+    auto read_u16 = [&ip]{
+        std::size_t v = ip[0] | (ip[1] << 8);
+        ip += 2;
+        return v;
+    };
+
+    for(;;){
+        switch(static_cast<opcode>(*ip++)){
+        case opcode::constant :
+            _stack.push_back(fn->constants[read_u16()]);
+            break;
+        case opcode::local :
+            _stack.push_back(_stack[base + read_u16()]);
+            break;
+        case opcode::capture :{
+            auto & self = _stack[base - 1].get<ast::Lambda>();
+            _stack.push_back(self.captures()[read_u16()]);
+            break;
+        }
+        case opcode::global :{
+            auto & site = fn->globals[read_u16()];
+            auto & env = _cls.global();
+            if(site.version != env.version()){
+                auto & value = env.at(env.slot(site.name));
+                if(!value) throw runtime_error(fmt::format("undefined {}" , site.name));
+                site.value = &*value;
+                site.version = env.version();
+            }
+            _stack.push_back(*site.value);
+            break;
+        }
+        case opcode::define :{
+            auto & name = fn->constants[read_u16()];
+            _cls.global().set(name.get<ast::Symbol>() , std::move(_stack.back()));
+            _stack.back() = name;
+            break;
+        }
+        case opcode::closure :{
+            auto value = make_closure(base , fn->functions[read_u16()]);
+            _stack.push_back(std::move(value));
+            break;
+        }
+        case opcode::jump :
+            ip = fn->code.data() + read_u16();
+            break;
+        case opcode::jump_if_not_true :{
+            auto target = read_u16();
+            if(_stack.back() != ast::Boolean{true}) ip = fn->code.data() + target;
+            _stack.pop_back();
+            break;
+        }
+        case opcode::jump_if_false :{
+            auto target = read_u16();
+            if(_stack.back() == ast::Boolean{false}) ip = fn->code.data() + target;
+            else _stack.pop_back();
+            break;
+        }
+        case opcode::jump_if_true :{
+            auto target = read_u16();
+            if(_stack.back() == ast::Boolean{true}) ip = fn->code.data() + target;
+            else _stack.pop_back();
+            break;
+        }
+        case opcode::call :{
+            std::size_t argc = *ip++;
+#ifdef LISPY_GC
+            // before a call every live value is on the stack or in code
+            if(safe_points && gc::should_collect()) Runtime::collect(fn);
+#endif
+            auto f = _stack.size() - argc - 1;
+            auto code = enter(argc);
+            if(!code) break;
+            if(_frames.size() >= _max_depth)
+                throw runtime_error(fmt::format("maximum recursion depth {} exceeded." , _max_depth));
+            _frames.push_back(Frame{.fn = fn , .ip = ip , .base = base});
+            fn = code;
+            ip = fn->code.data();
+            base = f + 1;
+            break;
+        }
+        case opcode::tail_call :{
+            std::size_t argc = *ip++;
+#ifdef LISPY_GC
+            if(safe_points && gc::should_collect()) Runtime::collect(fn);
+#endif
+            auto f = _stack.size() - argc - 1;
+            auto code = enter(argc);
+            // builtins and partial applications are already done , the following ret returns them
+            if(!code) break;
+            // otherwise the callee and its locals take over the running frame
+            auto n = _stack.size() - f;
+            std::move(_stack.begin() + f , _stack.end() , _stack.begin() + base - 1);
+            _stack.erase(_stack.begin() + base - 1 + n , _stack.end());
+            fn = code;
+            ip = fn->code.data();
+            break;
+        }
+        case opcode::ret :{
+            auto result = std::move(_stack.back());
+            if(_frames.size() == bottom){
+                _stack.pop_back();
+                return result;
+            }
+            // the result replaces the callee slot of the caller
+            _stack.erase(_stack.begin() + base , _stack.end());
+            _stack.back() = std::move(result);
+            auto & caller = _frames.back();
+            fn = caller.fn;
+            ip = caller.ip;
+            base = caller.base;
+            _frames.pop_back();
+            break;
+        }
+        case opcode::fail :{
+            auto & failure = fn->failures[read_u16()];
+            if(failure.syntax) throw bad_syntax(failure.message);
+            throw runtime_error(failure.message);
+        }
+        }
+    }
+}
+
+#ifdef LISPY_GC
+void Machine::trace(gc::tracer & t , const Function * running) const{
+    for(auto & e : _stack) t.mark(e);
+    for(auto & frame : _frames) t.mark(*frame.fn);
+    if(running) t.mark(*running);
+}
+#endif
+
+ast::SExpr Machine::make_closure(std::size_t base , const ast::cow<ast::LambdaCode> & code){
+    auto & captures = code->compiled->captures;
+    return ast::SExpr::lambda(code , captures.size() , 0 , [&](std::span<ast::SExpr> values){
+        for(std::size_t i = 0 ; i < captures.size() ; ++i){
+            auto & c = captures[i];
+            values[i] = c.from_local
+                ? _stack[base + c.index]
+                : _stack[base - 1].get<ast::Lambda>().captures()[c.index];
+        }
+    });
+}
+
+// the callee sits at _stack[top - argc] , followed by its arguments.
+// builtins and partial applications replace them all by the result and return null ,
+// a full application of a closure lays out its locals and returns its code.
+const Function * Machine::enter(std::size_t argc){
+    auto f = _stack.size() - argc - 1;
+    auto & head = _stack[f];
+
+    if(auto builtin = head.get_if<ast::BuiltinFn>()){
+        if(builtin->arity == argc){
+            call_builtin(argc);
+            return nullptr;
+        }
+        // partial applications curry , and report a wrong count , like any lambda
+        head = builtin_lambda(*builtin);
+    }
+
+    if(!head.holds<ast::Lambda>())
+        throw runtime_error(fmt::format(
+            "not a procedure , given {} , \nin {}" ,
+            ast::print_sexpr(head) , ast::print_sexpr(call_list(_stack.begin() + f , _stack.end()))));
+
+    const auto & lambda = head.get<ast::Lambda>();
+    auto n_except = lambda.expected();
+    // too many arguments
+    if(n_except < argc)
+        throw runtime_error(fmt::format(
+            "argument size mismatch in {}, expect {} , got {} , ",
+            ast::print_sexpr(call_list(_stack.begin() + f , _stack.end())) , n_except , argc + 1));
+
+    //currying
+    if(n_except > argc){
+        auto curried = ast::curry(lambda , std::ranges::subrange(_stack.begin() + f + 1 , _stack.end()));
+        _stack.erase(_stack.begin() + f , _stack.end());
+        _stack.emplace_back(std::move(curried));
+        return nullptr;
+    }
+
+    //invoke
+    LISPY_COUNT(invocations);
+    // lambda stays in place , it lives in the Object the callee slot holds
+    auto bounded = lambda.bounded();
+    if(!bounded.empty()) _stack.insert(_stack.begin() + f + 1 , bounded.begin() , bounded.end());
+    // code compiled on demand is kept for every closure sharing it
+    auto & code = *lambda.code;
+    if(!code.compiled) code.compiled = compile(code);
+    return code.compiled.get();
+}
+
+void Machine::call_builtin(std::size_t argc){
+    LISPY_COUNT(builtin_calls);
+    auto f = _stack.size() - argc - 1;
+    ast::vector<ast::SExpr> ls{};
+    for(auto & e : std::ranges::subrange(_stack.begin() + f , _stack.end()))
+        ls.emplace_back(std::move(e));
+    _stack.erase(_stack.begin() + f , _stack.end());
+
+    ast::List params{std::move(ls)};
+    auto fn = params->begin()->get<ast::BuiltinFn>().fn;
+    _stack.emplace_back(fn(_cls , params));
+}
+
+}
+
+namespace lispy {
+
+ast::SExpr Runtime::execute(const ast::SExpr & sexpr){
+    auto fn = vm::compile(sexpr);
+    return instance()._vm.run(*fn);
+}
+
+ast::SExpr Runtime::apply(ast::SExpr f , ast::vector<ast::SExpr> args){
+    return instance()._vm.apply(std::move(f) , std::move(args));
+}
+
+}
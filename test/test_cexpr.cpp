@@ -1,11 +1,13 @@
 #include <gtest/gtest.h>
 #include <variant>
 #include <optional>
+#include <thread>
 #include "constexpr_containers.hpp"
 
 using cexpr::vector;
 using cexpr::box;
 using cexpr::cow;
+using cexpr::small_vector;
 
 constexpr auto test_const(){
     int n = 0;
@@ -35,7 +37,17 @@ constexpr bool test_box_const(){
     return *b == 1;
 }
 
+constexpr auto test_small_vector_const(){
+    small_vector<int , 2> v{1};
+    v.push_back(2);
+    v.push_back(3);
+    auto v2 = v;
+    auto v3 = std::move(v2);
+    return v3.size() + v3[2] + v2.size();
+}
+
 static_assert(test_const() == 4);
+static_assert(test_small_vector_const() == 6);
 static_assert(test_cv().size() == 4);
 static_assert(test_cv_copy() == 7);
 static_assert(test_box_const());
@@ -79,6 +91,49 @@ TEST(test_cexpr , test_vector){
     EXPECT_EQ(v5.begin() , nullptr);
 }
 
+TEST(test_cexpr , test_small_vector){
+    small_vector<int , 4> v{1 , 2};
+    auto inside = [](auto & v){
+        auto p = reinterpret_cast<const std::byte *>(v.begin());
+        auto self = reinterpret_cast<const std::byte *>(&v);
+        return self <= p && p < self + sizeof(v);
+    };
+    EXPECT_EQ(v.capacity() , 4);
+    EXPECT_TRUE(inside(v));
+
+    auto moved = std::move(v);
+    EXPECT_TRUE(inside(moved));
+    EXPECT_EQ(moved.size() , 2);
+    EXPECT_EQ(v.size() , 0);
+
+#ifdef CEXPR_STATS
+    auto grows = cexpr::counters.vector_grows;
+#endif
+    for(int i = 3 ; i <= 5 ; ++i) moved.push_back(i);
+    EXPECT_FALSE(inside(moved));
+    EXPECT_EQ(moved.capacity() , 8);
+#ifdef CEXPR_STATS
+    // only reallocating heap storage counts , as for vector
+    EXPECT_EQ(cexpr::counters.vector_grows , grows);
+    auto grown = moved;
+    for(int i = 6 ; i <= 9 ; ++i) grown.push_back(i);
+    EXPECT_EQ(cexpr::counters.vector_grows , grows + 1);
+#endif
+    for(auto i = 1 ; auto x : moved){
+        EXPECT_EQ(x , i);
+        ++i;
+    }
+
+    // copies take the exact size , not the 1.5x of vector
+    auto copy = moved;
+    EXPECT_EQ(copy.capacity() , 5);
+    EXPECT_EQ(copy , (small_vector<int , 4>{1 , 2 , 3 , 4 , 5}));
+
+    v = small_vector<int , 4>{7};
+    EXPECT_TRUE(inside(v));
+    EXPECT_EQ(v[0] , 7);
+}
+
 TEST(test_cexpr , test_box){
     box b{1};   
     EXPECT_TRUE(b);
@@ -131,8 +186,37 @@ TEST(test_cexpr , test_cow){
     using var = std::variant<cow<foo>, foo>;
     var a{cow{foo{1}}};
     ASSERT_EQ(std::get<cow<foo>>(a).cnt() ,1);
-    a = std::get<cow<foo>>(a).mut();
+    // copy out first , assigning a reference into the storage it lives in is undefined
+    a = foo{std::get<cow<foo>>(a).mut()};
 
     ASSERT_TRUE(std::holds_alternative<foo>(a));
     ASSERT_EQ(std::get<foo>(a) , foo{1});
-}
\ No newline at end of file
+}
+TEST(test_cexpr , test_cow_count_policy){
+    cow<int , std::allocator<int> , cexpr::ref_count_t> p{1};
+    auto p2 = p;
+    EXPECT_EQ(p.cnt() , 2);
+
+    cow<int , std::allocator<int> , cexpr::ref_count_safe_t> s{1};
+    auto s2 = s;
+    EXPECT_EQ(s.cnt() , 2);
+
+    // copies and drops from other threads , once counts are shared
+    EXPECT_FALSE(cexpr::counts_shared());
+    cow shared{std::vector<int>(16 , 1)};
+    {
+        cexpr::sharing_scope sharing{};
+        std::vector<std::thread> ts{};
+        for(int t = 0 ; t < 4 ; ++t)
+            ts.emplace_back([shared]{
+                for(int i = 0 ; i < 10000 ; ++i){
+                    auto c = shared;
+                    EXPECT_EQ(c.ref().size() , 16);
+                }
+            });
+        for(auto & t : ts) t.join();
+    }
+    EXPECT_EQ(shared.cnt() , 1);
+    // the tests after this one count plainly again
+    EXPECT_FALSE(cexpr::counts_shared());
+}
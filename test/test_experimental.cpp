@@ -0,0 +1,145 @@
+#include <forward_list>
+#include <functional>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "parser/experimental/parser.h"
+
+using namespace std::literals;
+
+template<class T>
+std::vector<T> to_vector(const std::forward_list<T> & list){
+    return {list.begin() , list.end()};
+}
+
+TEST(test_experimental , test_char_parser){
+    EXPECT_FALSE(item(""));
+    auto r = item("ab");
+    ASSERT_TRUE(r);
+    EXPECT_EQ(r->first , 'a');
+    EXPECT_EQ(r->second , "b"sv);
+
+    EXPECT_TRUE(digit("1"));
+    EXPECT_FALSE(digit("a"));
+    EXPECT_TRUE(alphanum("a1"));
+    EXPECT_TRUE(oneof("+-")("-1"));
+    EXPECT_FALSE(oneof("+-")("1"));
+
+    auto s = "let"_string("letter");
+    ASSERT_TRUE(s);
+    EXPECT_EQ(s->first , "let"sv);
+    EXPECT_EQ(s->second , "ter"sv);
+    EXPECT_FALSE(string("let")("le"));
+    EXPECT_FALSE(string("let")(""));
+}
+
+TEST(test_experimental , test_word){
+    auto w = word("hello world");
+    ASSERT_TRUE(w);
+    EXPECT_EQ(w->first , "hello");
+    EXPECT_EQ(w->second , " world"sv);
+
+    // zero letters is an empty word
+    auto empty = word("1a");
+    ASSERT_TRUE(empty);
+    EXPECT_EQ(empty->first , "");
+    EXPECT_EQ(empty->second , "1a"sv);
+
+    std::string large(100'000 , 'w');
+    auto input = large + "1";
+    auto l = word(input);
+    ASSERT_TRUE(l);
+    EXPECT_EQ(l->first , large);
+    EXPECT_EQ(l->second , "1"sv);
+}
+
+TEST(test_experimental , test_ints){
+    auto r = ints<int>("[1,-22,333]tail");
+    ASSERT_TRUE(r);
+    EXPECT_EQ(to_vector(r->first) , (std::vector{1 , -22 , 333}));
+    EXPECT_EQ(r->second , "tail"sv);
+
+    EXPECT_FALSE(ints<int>("[]"));
+    EXPECT_FALSE(ints<int>("[1,]"));
+    EXPECT_FALSE(ints<int>("[1"));
+    EXPECT_FALSE(ints<int>("1]"));
+
+    std::string input = "[";
+    std::vector<int> expected{};
+    for(int i = 0 ; i < 10'000 ; ++i){
+        expected.push_back(i % 2 ? -i : i);
+        if(i) input += ',';
+        input += std::to_string(expected.back());
+    }
+    input += ']';
+    auto l = ints<int>(input);
+    ASSERT_TRUE(l);
+    EXPECT_EQ(to_vector(l->first) , expected);
+    EXPECT_EQ(l->second , ""sv);
+}
+
+TEST(test_experimental , test_sepby){
+    auto list = sepby(natural<int> , ','_char);
+
+    auto empty = list("");
+    ASSERT_TRUE(empty);
+    EXPECT_TRUE(empty->first.empty());
+    EXPECT_EQ(empty->second , ""sv);
+
+    auto none = list("a,1");
+    ASSERT_TRUE(none);
+    EXPECT_TRUE(none->first.empty());
+    EXPECT_EQ(none->second , "a,1"sv);
+
+    // a trailing separator is left unparsed
+    auto r = list("1,2,");
+    ASSERT_TRUE(r);
+    EXPECT_EQ(to_vector(r->first) , (std::vector{1 , 2}));
+    EXPECT_EQ(r->second , ","sv);
+
+    EXPECT_FALSE(sepby1(natural<int> , ','_char)(""));
+    EXPECT_FALSE(many1(digit)(""));
+}
+
+TEST(test_experimental , test_chain){
+    auto minus = '-'_char >> result(std::minus<int>{});
+    auto left = chainl1(natural<int> , minus);
+    auto right = chainr1(natural<int> , minus);
+
+    auto l = left("10-2-3");
+    ASSERT_TRUE(l);
+    EXPECT_EQ(l->first , 5);
+    auto r = right("10-2-3");
+    ASSERT_TRUE(r);
+    EXPECT_EQ(r->first , 11);
+
+    // an operator without its right operand is left unparsed
+    auto rest = left("1-2-");
+    ASSERT_TRUE(rest);
+    EXPECT_EQ(rest->first , -1);
+    EXPECT_EQ(rest->second , "-"sv);
+    EXPECT_FALSE(left("-1"));
+    EXPECT_FALSE(right(""));
+
+    // 1-1-...-1 of n ones : 2-n from the left , n % 2 from the right
+    auto ones = [](int n){
+        std::string s = "1";
+        for(int i = 1 ; i < n ; ++i) s += "-1";
+        return s;
+    };
+    auto input = ones(100'000);
+    auto long_left = left(input);
+    ASSERT_TRUE(long_left);
+    EXPECT_EQ(long_left->first , 2 - 100'000);
+    EXPECT_EQ(long_left->second , ""sv);
+
+    // chainr1 recurses once per operand
+    for(int n : {1'000 , 1'001}){
+        auto operands = ones(n);
+        auto long_right = right(operands);
+        ASSERT_TRUE(long_right);
+        EXPECT_EQ(long_right->first , n % 2);
+        EXPECT_EQ(long_right->second , ""sv);
+    }
+}
@@ -1,8 +1,13 @@
 #include <gtest/gtest.h>
+#include <fmt/format.h>
+#include <limits>
 #include <vector>
+#include <unistd.h>
 #include "ast.h"
 #include "lispy.h"
+#include "reader.h"
 #include "runtime.h"
+#include "structural.h"
 
 using namespace lispy;
 using namespace std::literals;
@@ -12,7 +17,7 @@ using ast::parse;
 TEST(test_lispy , test_types){
 
     ast::Symbol a = "+" , b = "-";
-    const ast::List ls({a , b});
+    const ast::List ls(ast::vector<ast::SExpr>{a , b});
     ast::SExpr e{ls};
     auto e2 = e;
 
@@ -22,6 +27,44 @@ TEST(test_lispy , test_types){
 
 }
 
+TEST(test_lispy , test_tagged_values){
+    static_assert(sizeof(ast::SExpr) == 8);
+
+    // fixnums and their boxed neighbours
+    for(ast::Integer i : {ast::Integer{0} , ast::Integer{-1} , std::numeric_limits<ast::Integer>::max() / 2 ,
+                          std::numeric_limits<ast::Integer>::max() , std::numeric_limits<ast::Integer>::min()}){
+        ast::SExpr e{i};
+        EXPECT_TRUE(e.holds<ast::Integer>());
+        EXPECT_EQ(e.get<ast::Integer>() , i);
+        EXPECT_EQ(e , ast::SExpr{i});
+    }
+    EXPECT_EQ(ast::print_sexpr(ast::SExpr{std::numeric_limits<ast::Integer>::min()}) , "-9223372036854775808");
+
+    EXPECT_TRUE(ast::SExpr{true}.get<ast::Boolean>());
+    EXPECT_NE(ast::SExpr{false} , ast::SExpr{0});
+    EXPECT_EQ(ast::SExpr{ast::Symbol{"x"}}.get<ast::Symbol>() , "x");
+    EXPECT_FALSE(ast::SExpr{ast::Symbol{"x"}}.get_if<ast::Quote>());
+
+    // copies share the Object , mut copies it first
+    ast::SExpr q = ast::Quote{ast::Symbol{"x"}};
+    auto q2 = q;
+    EXPECT_EQ(q , q2);
+    EXPECT_EQ(q.get_if<ast::Quote>() , q2.get_if<ast::Quote>());
+    [[maybe_unused]] auto clones = Runtime::stats().cow_clones;
+    q2.mut<ast::Quote>().value = ast::Symbol{"y"};
+    EXPECT_NE(q , q2);
+    EXPECT_EQ(ast::print_sexpr(q) , "'x");
+#ifdef CEXPR_STATS
+    // (runtime-stats) reports the copy as a cow clone
+    EXPECT_EQ(Runtime::stats().cow_clones , clones + 1);
+#ifndef LISPY_GC
+    // the copy is q2's alone , it changes in place
+    q2.mut<ast::Quote>().value = ast::Symbol{"z"};
+    EXPECT_EQ(Runtime::stats().cow_clones , clones + 1);
+#endif
+#endif
+}
+
 TEST(test_lispy , test_parse){
 
     EXPECT_TRUE (parse("#t").value().holds<ast::Boolean>());
@@ -47,6 +90,59 @@ TEST(test_lispy , test_parse){
     EXPECT_TRUE (parse("(())"));
 }
 
+TEST(test_lispy , test_parse_as_combinators){
+    auto printed = [](const std::optional<ast::SExpr> & e){
+        return e ? ast::print_sexpr(*e) : "<error>"s;
+    };
+    // the reader , and the indexed reader on every instruction set , agree with the combinators
+    auto same = [&](std::string_view input){
+        auto expected = printed(ast::parse_combinators(input));
+        if(printed(parse(input)) != expected) return false;
+        for(auto isa : {structural::isa::scalar , structural::isa::sse2 , structural::isa::avx2})
+            if(printed(structural::parse(input , isa)) != expected) return false;
+        return true;
+    };
+    for(auto input : {
+        "" , "  " , "a" , " a\n" , "-" , "-a" , "-12" , "-12a" , "12a" , "a12" , "#t" , "#f" , "#tx" , "#x" , "#" ,
+        "99999999999999999999" , "-9223372036854775808" , "a\\b" , "\r" , "a\rb" , "\xff" ,
+        "()" , "( )" , "(\t)" , "(a)" , "( a )" , "(a b)" , "(a  b\n c)" , "(a(b))" , "((a)(b))" , "((a) (b))" ,
+        "(a 'b)" , "(a'b)" , "'a" , "''a" , "' a" , "'" , "'()" , "'(a '(b 'c))" , "(a ')" , "(a" , "a)" , "(a))" ,
+        "(#t#f)" , "(#t #f -1 1)" , "(1 -)" , "((()))" , "(()())" , "(() ())" , "(a) b" , "a(b)" , "')" ,
+    }) EXPECT_TRUE(same(input)) << input;
+    // literals out of range wrap around modulo 2^64 in both
+    EXPECT_EQ(printed(ast::parse_combinators("99999999999999999999")) , "7766279631452241919");
+    EXPECT_EQ(printed(ast::parse_combinators("-9223372036854775808")) , "-9223372036854775808");
+
+    // atoms and spaces across the blocks of 64 bytes and the chunks of the indexer
+    std::string large = "'(";
+    for(int i = 0 ; large.size() < 3 * structural::indexer::chunk ; ++i)
+        large += fmt::format("(item-{} {}{} 'sym\t#t)\n" , i , -i , std::string(i % 70 , ' '));
+    EXPECT_TRUE(parse(large + ")"));
+    EXPECT_TRUE(same(large + ")"));
+    EXPECT_TRUE(same(large + "x)"));
+    EXPECT_TRUE(same(large));
+
+    // lists close without recursing , however deep they nest
+    std::string deep(100'000 , '(');
+    deep.append(100'000 , ')');
+    EXPECT_TRUE(parse(deep));
+    EXPECT_TRUE(structural::parse(deep));
+}
+
+TEST(test_lispy , test_symbol_interning){
+    auto buffer = std::make_unique<std::string>("(lat? (quote lat?))");
+    auto res = parse(*buffer);
+    buffer.reset();
+
+    // symbols do not refer to the parsed input
+    ASSERT_TRUE(res);
+    auto & ls = res->get<ast::List>().ref();
+    EXPECT_EQ(ls[0].get<ast::Symbol>() , "lat?");
+    EXPECT_EQ(ls[0] , ls[1].get<ast::List>().ref()[1]);
+    EXPECT_EQ(ast::Symbol{"lat?"}.name().data() , ls[0].get<ast::Symbol>().name().data());
+    EXPECT_NE(ast::Symbol{"lat"} , ast::Symbol{"lat?"});
+}
+
 TEST(test_lispy , test_define){
     EXPECT_EQ(Runtime::eval("(define x '1)") , "x");
     EXPECT_EQ(Runtime::eval("x") , "1");
@@ -87,6 +183,15 @@ TEST(test_lispy , test_builtin){
 
     EXPECT_EQ(Runtime::eval("(add1 67)") , "68");
     EXPECT_EQ(Runtime::eval("(sub1 5)") , "4");
+
+    // builtins are called directly , partial applications still curry
+    EXPECT_EQ(Runtime::eval("car") , "#<builtin :car>");
+    for(auto mode : {eval_mode::tree_walk , eval_mode::bytecode}){
+        EXPECT_EQ(Runtime::eval("((cons 'a) '(b))" , mode) , "'(a b)");
+        EXPECT_EQ(Runtime::eval("(((cons) 'a) '(b))" , mode) , "'(a b)");
+        EXPECT_EQ(Runtime::eval("((lambda (f) (f 1)) add1)" , mode) , "2");
+        EXPECT_THROW(Runtime::eval("(add1 1 2)" , mode) , runtime_error);
+    }
 }
 
 TEST(test_lispy , test_lambda){
@@ -122,4 +227,351 @@ TEST(test_lispy , test_cond){
     EXPECT_EQ(Runtime::eval("(foo '())"), "'is_null");
     EXPECT_EQ(Runtime::eval("(foo 0)") , "'is_zero");
     EXPECT_EQ(Runtime::eval("(foo 2)") ,"false");
-}
\ No newline at end of file
+}
+TEST(test_lispy , test_tail_call){
+    Runtime::eval(R"(
+        (define count-down
+            (lambda (n)
+            (cond
+                ((zero? n) 'done)
+                (else (count-down (sub1 n))))))
+    )");
+    Runtime::eval(R"(
+        (define even-odd?
+            (lambda (n even)
+            (cond
+                ((zero? n) even)
+                (else (and #t (or #f (even-odd? (sub1 n) (eq? even #f))))))))
+    )");
+
+    // deep enough to overflow the native stack without tail calls
+    for(auto mode : {eval_mode::tree_walk , eval_mode::bytecode}){
+        EXPECT_EQ(Runtime::eval("(count-down 100000)" , mode) , "'done");
+        EXPECT_EQ(Runtime::eval("(even-odd? 50001 #t)" , mode) , "false");
+        EXPECT_EQ(Runtime::eval("((lambda (n) (count-down n)) 100000)" , mode) , "'done");
+    }
+}
+
+TEST(test_lispy , test_lexical_scope){
+    // globals used before their definition are looked up when called
+    Runtime::eval("(define call-later (lambda (x) (later x)))");
+    EXPECT_ANY_THROW(Runtime::eval("(call-later 1)" , eval_mode::tree_walk));
+    Runtime::eval("(define later (lambda (x) (add1 x)))");
+
+    std::vector cases{
+        "(call-later 1)"sv,
+        "(((lambda (x) (lambda (y) (cons x y))) 'a) '(b))"sv,
+        "(((lambda (x) (lambda (x) x)) 'outer) 'inner)"sv,
+        "((lambda (x x) x) 1 2)"sv,
+        "((((lambda (a) (lambda (b) (lambda (c) (cons a (cons b (cons c '())))))) 1) 2) 3)"sv,
+        "((lambda (x) (cond ((eq? x 'else) 'kw) (else x))) 'else)"sv,
+        "((lambda (car) (cons car '())) 'a)"sv,
+        "((lambda (x) '(x y)) 1)"sv,
+    };
+    std::vector expects{"2"sv , "'(a b)"sv , "'inner"sv , "2"sv , "'(1 2 3)"sv , "'kw"sv , "'(a)"sv , "'(x y)"sv};
+
+    for(std::size_t i = 0 ; i < cases.size() ; ++i){
+        EXPECT_EQ(Runtime::eval(cases[i] , eval_mode::tree_walk) , expects[i]) << cases[i];
+        EXPECT_EQ(Runtime::eval(cases[i] , eval_mode::bytecode) , expects[i]) << cases[i];
+    }
+
+    // closures built by the tree walker run on the vm and the other way round
+    Runtime::eval("(define pair-with (lambda (n) (lambda (m) (cons n (cons m '())))))" , eval_mode::tree_walk);
+    EXPECT_EQ(Runtime::eval("((pair-with 1) 2)" , eval_mode::bytecode) , "'(1 2)");
+    Runtime::eval("(define pair-2 (pair-with 2))" , eval_mode::tree_walk);
+    EXPECT_EQ(Runtime::eval("(pair-2 3)" , eval_mode::bytecode) , "'(2 3)");
+    Runtime::eval("(define pair-3 (pair-with 3))" , eval_mode::bytecode);
+    EXPECT_EQ(Runtime::eval("(pair-3 3)" , eval_mode::tree_walk) , "'(3 3)");
+}
+
+TEST(test_lispy , test_no_code_copy){
+    // same calls , the second body is much larger but its extra clauses never run
+    Runtime::eval(R"(
+        (define cnt-s
+            (lambda (n)
+            (cond
+                ((zero? n) 'done)
+                (else (cnt-s (sub1 n))))))
+    )");
+    Runtime::eval(R"(
+        (define cnt-l
+            (lambda (n)
+            (cond
+                ((zero? n) 'done)
+                (#f (cons '(a b c d e f g) (cons n (cons n (cons n '())))))
+                (#f (and (cnt-l n) (or (cnt-l n) (cnt-l n)) (cons n n)))
+                (#f ((lambda (x y z) (cons x (cons y (cons z '())))) n n n))
+                (else (cnt-l (sub1 n))))))
+    )");
+
+#ifdef LISPY_STATS
+    // what copying a body would allocate : its values , list storage and vectors
+    auto allocs_of = [](std::string_view input , eval_mode mode){
+        Runtime::reset_stats();
+        Runtime::eval(input , mode);
+        auto counted = Runtime::stats();
+        return counted.cow_allocs + counted.cow_clones + counted.vector_grows;
+    };
+
+    // reading the code of a call never allocates , so the size of the body does not show
+    for(auto mode : {eval_mode::tree_walk , eval_mode::bytecode}){
+        allocs_of("(cnt-s 1)" , mode);
+        allocs_of("(cnt-l 1)" , mode);
+        EXPECT_EQ(allocs_of("(cnt-s 1000)" , mode) , allocs_of("(cnt-l 1000)" , mode));
+        EXPECT_EQ(allocs_of("(cnt-s 2000)" , mode) , allocs_of("(cnt-l 2000)" , mode));
+    }
+#endif
+}
+
+TEST(test_lispy , test_flat_closure){
+    Environment env{};
+    Closure cls{env};
+    auto make = [&](std::string_view code){
+        return Runtime::eval_sexpr(cls , parse(code).value());
+    };
+
+    // parameters and globals are never captured
+    auto fe = make("((lambda (x y) (lambda (z) (cons x (car z)))) 1 2)");
+    auto & f = fe.get<ast::Lambda>();
+    ASSERT_EQ(f.captures().size() , 1);
+    EXPECT_EQ(ast::print_sexpr(f.code->captures[0]) , "x");
+    EXPECT_EQ(f.captures()[0] , ast::SExpr{1});
+
+    // the middle lambda captures a for the inner one
+    auto ge = make("(((lambda (a b) (lambda (c) (lambda (d) (cons a d)))) 1 2) 3)");
+    auto & g = ge.get<ast::Lambda>();
+    ASSERT_EQ(g.captures().size() , 1);
+    EXPECT_EQ(ast::print_sexpr(g.code->captures[0]) , "a");
+
+    EXPECT_TRUE(make("(lambda (x) (cons x '(y)))").get<ast::Lambda>().captures().empty());
+}
+
+TEST(test_lispy , test_closure_allocation){
+#ifdef CEXPR_STATS
+    // the closure of the Y combinator , its code is shared and its captures are stored inline
+    for(auto mode : {eval_mode::tree_walk , eval_mode::bytecode}){
+        Runtime::eval("(define mk (lambda (F f) (lambda (n) ((F (f f)) n))))" , mode);
+        Runtime::eval("(define same (lambda (F f) F))" , mode);
+        auto allocs_of = [&](std::string_view input){
+            Runtime::reset_stats();
+            Runtime::eval(input , mode);
+            return Runtime::stats().cow_allocs;
+        };
+        EXPECT_EQ(allocs_of("(mk 1 2)") - allocs_of("(same 1 2)") , 1);
+    }
+#endif
+}
+
+TEST(test_lispy , test_shared_tail){
+    auto l = parse("(a b c)").value().get<ast::List>();
+    auto tail = l.cdr();
+    ASSERT_EQ(tail.size() , 2);
+    EXPECT_EQ(&tail[0] , &l[1]);
+
+    // the first cons onto a tail copies it once , later ones store in place
+    auto x = ast::List::cons(ast::Symbol{"x"} , tail);
+    auto y = ast::List::cons(ast::Symbol{"y"} , x);
+    auto z = ast::List::cons(ast::Symbol{"z"} , x);
+    EXPECT_EQ(&y[1] , &x[0]);
+    EXPECT_NE(&z[1] , &x[0]);
+
+    EXPECT_EQ(ast::print_sexpr(l) , "(a b c)");
+    EXPECT_EQ(ast::print_sexpr(x) , "(x b c)");
+    EXPECT_EQ(ast::print_sexpr(y) , "(y x b c)");
+    EXPECT_EQ(ast::print_sexpr(z) , "(z x b c)");
+
+    Runtime::eval("(define shared '(a b c))");
+    EXPECT_EQ(Runtime::eval("(cons 'x (cdr shared))") , "'(x b c)");
+    EXPECT_EQ(Runtime::eval("(cons 'y (cdr shared))") , "'(y b c)");
+    EXPECT_EQ(Runtime::eval("(cons 'z shared)") , "'(z a b c)");
+    EXPECT_EQ(Runtime::eval("shared") , "'(a b c)");
+}
+
+TEST(test_lispy , test_runtime_stats){
+    auto define = "(define count-down (lambda (n) (cond ((zero? n) 'done) (else (count-down (sub1 n))))))";
+    Runtime::eval(define);
+
+    auto stats = Runtime::eval("(runtime-stats)");
+    EXPECT_NE(stats.find("(builtin-calls ") , stats.npos) << stats;
+    EXPECT_NE(stats.find("(cow-clones ") , stats.npos) << stats;
+
+#ifdef LISPY_STATS
+    for(auto mode : {eval_mode::tree_walk , eval_mode::bytecode}){
+        Runtime::eval(define , mode);
+        Runtime::reset_stats();
+        Runtime::eval("(count-down 10)" , mode);
+        auto counted = Runtime::stats();
+        EXPECT_EQ(counted.invocations , 11);
+        EXPECT_EQ(counted.builtin_calls , 21);
+        EXPECT_EQ(counted.environments , mode == eval_mode::tree_walk ? 11 : 0);
+    }
+    Runtime::reset_stats();
+    // parsing and compiling the call allocates , running it calls only the builtin
+    EXPECT_TRUE(Runtime::eval("(runtime-stats)").ends_with("(environments 0) (invocations 0) (builtin-calls 1))"));
+#endif
+}
+
+TEST(test_lispy , test_arena){
+    arena a{};
+    {
+        arena::scope form{a};
+        auto p = arena_allocator<int>{}.allocate(4);
+        EXPECT_TRUE(a.owns(p));
+        {
+            arena::pause heap{};
+            auto q = arena_allocator<int>{}.allocate(1);
+            EXPECT_FALSE(a.owns(q));
+            arena_allocator<int>{}.deallocate(q , 1);
+        }
+        arena_allocator<int>{}.deallocate(p , 4);
+    }
+    EXPECT_EQ(arena::current() , nullptr);
+
+    // past max_size the heap takes over , its blocks are still the form's
+    arena full{arena::first_chunk};
+    {
+        arena::scope form{full};
+        auto first = full.allocate(arena::first_chunk / 2 , 8);
+        auto second = full.allocate(arena::first_chunk / 2 , 8);
+        EXPECT_TRUE(full.owns(first));
+        EXPECT_TRUE(full.owns(second));
+        EXPECT_EQ(full.reserved() , full.max_size());
+
+        auto p = arena_allocator<int>{}.allocate(4);
+        EXPECT_TRUE(full.owns(p));
+        EXPECT_TRUE(full.owns(p + 3));
+        EXPECT_TRUE(full.deallocate(p));
+        EXPECT_FALSE(full.deallocate(p));
+
+        // so cons still stores right after the tail
+        ast::List tail{ast::vector<ast::SExpr>{ast::SExpr{1}}};
+        EXPECT_TRUE(tail.stored_in(full));
+        auto list = ast::List::cons(ast::SExpr{2} , tail);
+        EXPECT_EQ(&list[1] , &tail[0]);
+
+        auto spilled = full.allocate(1024 , 8);
+        EXPECT_TRUE(full.owns(spilled));
+        EXPECT_EQ(full.reserved() , full.max_size());
+        EXPECT_TRUE(full.deallocate(spilled));
+        EXPECT_FALSE(full.owns(spilled));
+    }
+
+    // defined values leave the arena of their form , which later forms reuse
+    Runtime::eval("(define kept (cons '(a b) '(c)))");
+    Runtime::eval("(define kept-fn ((lambda (x) (lambda (y) (cons x y))) 'k))");
+    Runtime::eval("(define kept-tail '(d e))");
+    // consing onto a global must not leave the form's values in the global's storage
+    EXPECT_EQ(Runtime::eval("(cons '(x y) kept-tail)") , "'((x y) d e)");
+    for(int i = 0 ; i < 100 ; ++i) Runtime::eval("(cons '(1 2 3) '(4 5 6))");
+
+    EXPECT_EQ(Runtime::eval("kept") , "'((a b) c)");
+    EXPECT_EQ(Runtime::eval("(kept-fn '(z))") , "'(k z)");
+    EXPECT_EQ(Runtime::eval("(kept-fn '(z))" , eval_mode::tree_walk) , "'(k z)");
+    EXPECT_EQ(Runtime::eval("(cons 'f kept-tail)") , "'(f d e)");
+
+    // only what the form allocated is copied out , a value defined earlier keeps its identity
+    Runtime::eval("(define same '(a b))");
+    Runtime::eval("(define same-too same)");
+    Runtime::eval("(define same-tail (cdr same))");
+    Runtime::eval("(define same? (lambda (l) (eq? l same)))");
+    for(auto mode : {eval_mode::bytecode , eval_mode::tree_walk}){
+        EXPECT_EQ(Runtime::eval("(eq? same same-too)" , mode) , "true");
+        EXPECT_EQ(Runtime::eval("(same? same-too)" , mode) , "true");
+        EXPECT_EQ(Runtime::eval("(same? '(a b))" , mode) , "false");
+    }
+    EXPECT_EQ(Runtime::eval("same-tail") , "'(b)");
+}
+
+#ifdef LISPY_GC
+TEST(test_lispy , test_collector){
+    Runtime::eval(R"(
+        (define gc-build
+            (lambda (n acc)
+            (cond
+                ((zero? n) acc)
+                (else (gc-build (sub1 n) (cons n acc))))))
+    )");
+    Runtime::eval("(define gc-kept (gc-build 5 '()))");
+    gc::root held{*parse("(a (b c))")};
+    auto before = gc::heap::instance().stats().collections;
+
+    // each form allocates past the threshold , so the vm collects while its accumulator is on the stack
+    for(auto mode : {eval_mode::bytecode , eval_mode::tree_walk})
+        for(int i = 0 ; i < 3 ; ++i)
+            EXPECT_EQ(Runtime::eval("(car (gc-build 400000 '()))" , mode) , "1");
+
+    auto stats = gc::heap::instance().stats();
+    EXPECT_GT(stats.collections , before + 2);
+    EXPECT_LT(stats.live_bytes , 64 * gc::heap::region_size);
+    EXPECT_EQ(Runtime::eval("gc-kept") , "'(1 2 3 4 5)");
+    EXPECT_EQ(Runtime::eval("(gc-build 2 '(x))") , "'(1 2 x)");
+    EXPECT_EQ(ast::print_sexpr(*held) , "(a (b c))");
+}
+#endif
+
+TEST(test_lispy , test_deep_drop){
+    // far deeper than the native stack would allow destructors to recurse
+    auto nested = [](int depth){
+        ast::SExpr e{ast::List{ast::vector<ast::SExpr>{}}};
+        for(int i = 0 ; i < depth ; ++i) e = ast::Quote{ast::List{ast::vector<ast::SExpr>{std::move(e) , i}}};
+        return e;
+    };
+    { auto deep = nested(1'000'000); }
+    EXPECT_EQ(ast::reclaim(0) , 0);
+
+#ifndef LISPY_GC
+    auto slice = ast::free_slice();
+    ast::set_free_slice(100);
+    {
+        ast::vector<ast::SExpr> wide{};
+        for(int i = 0 ; i < 1000 ; ++i) wide.push_back(nested(2));
+        ast::SExpr dropped{ast::List{std::move(wide)}};
+    }
+    auto waiting = ast::reclaim(0);
+    EXPECT_GT(waiting , 0);
+    // each drop frees another slice
+    { ast::SExpr dropped{ast::List{ast::vector<ast::SExpr>{}}}; }
+    EXPECT_LT(ast::reclaim(0) , waiting);
+    EXPECT_EQ(ast::reclaim() , 0);
+    ast::set_free_slice(slice);
+#endif
+}
+
+TEST(test_lispy , test_form_reader){
+    std::string_view input = " (define a '(1 (2)))\n a 'b\t''(c) -12 ) (d";
+    std::vector<std::string> expected{"(define a '(1 (2)))" , "a" , "'b" , "''(c)" , "-12" , ")" , "(d"};
+    // forms come out whole however the input is cut
+    for(std::size_t size : {1 , 3 , 1000}){
+        ast::form_reader reader{};
+        std::vector<std::string> forms{};
+        for(std::size_t i = 0 ; i < input.size() ; i += size){
+            reader.feed(input.substr(i , size));
+            while(auto form = reader.next()) forms.emplace_back(*form);
+        }
+        EXPECT_EQ(reader.buffered() , 2);
+        reader.finish();
+        while(auto form = reader.next()) forms.emplace_back(*form);
+        EXPECT_EQ(forms , expected);
+    }
+
+    // only the unfinished form stays buffered
+    ast::form_reader reader{};
+    for(int i = 0 ; i < 10'000 ; ++i){
+        reader.feed("(x y) (z ");
+        EXPECT_EQ(reader.next() , "(x y)");
+        reader.feed("w) ");
+        EXPECT_EQ(reader.next() , "(z w)");
+        EXPECT_FALSE(reader.next());
+    }
+    EXPECT_EQ(reader.buffered() , 0);
+
+    int fds[2];
+    ASSERT_EQ(pipe(fds) , 0);
+    std::string_view program = "(define loaded-id (lambda (x) x))\n(loaded-id 'a)\n(loaded-id '(b c))";
+    ASSERT_EQ(write(fds[1] , program.data() , program.size()) , program.size());
+    close(fds[1]);
+    std::vector<std::string> results{};
+    EXPECT_EQ(Runtime::load(fds[0] , [&](const std::string & r){ results.push_back(r); }) , 3);
+    close(fds[0]);
+    EXPECT_EQ(results.back() , "'(b c)");
+}
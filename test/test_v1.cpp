@@ -105,7 +105,31 @@ TEST(test_v1 , test_combinator){
 
 TEST(test_v1 , test_constexpr){
     static_assert( ("111"_str ("11111")).value().second == "11"sv);
-    // static_assert(many(digit)("1111").value().first.size() == 4);
+    static_assert(many(digit)("1111").value().first.size() == 4);
+    static_assert(fmap(std::plus<int>{} , chars(digit) >> result(1) , result(2))("11").value().first == 3);
+}
+
+TEST(test_v1 , test_sink){
+    std::vector<char> out{'0'};
+    auto digits = many_into(digit , out);
+
+    auto res = digits("12a");
+    EXPECT_TRUE(res);
+    EXPECT_EQ(res->first , 2);
+    EXPECT_EQ(res->second , "a"sv);
+    EXPECT_EQ(out , (std::vector{'0','1','2'}));
+
+    auto none = digits("a");
+    EXPECT_TRUE(none);
+    EXPECT_EQ(none->first , 0);
+    EXPECT_EQ(out.size() , 3);
+
+    std::vector<std::string_view> words{};
+    auto list = '('_char >> sepby_into(chars(letter) , spaces1 , words) << ')'_char;
+    EXPECT_TRUE(list("(ab c)"));
+    EXPECT_TRUE(list("()"));
+    EXPECT_TRUE(list("(d)"));
+    EXPECT_EQ(words , (std::vector{"ab"sv , "c"sv , "d"sv}));
 }
 
 namespace {
@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+#include <string>
+
+#include "runtime.h"
+#include "vm.h"
+
+using namespace lispy;
+using namespace std::literals;
+
+TEST(test_vm , test_compile){
+    auto fn = vm::compile(ast::parse("(cond ((null? l) #t) (else (and #t (or #f 1))))").value());
+    auto code = vm::disassemble(*fn);
+
+    EXPECT_NE(code.find("global null?") , code.npos);
+    EXPECT_NE(code.find("jump_if_not_true") , code.npos);
+    EXPECT_NE(code.find("jump_if_false") , code.npos);
+    EXPECT_NE(code.find("jump_if_true") , code.npos);
+    EXPECT_NE(code.find("call 1") , code.npos);
+    EXPECT_EQ(fn->code.back() , static_cast<uint8_t>(vm::opcode::ret));
+
+    auto lambda = vm::compile(ast::parse("(lambda (x) (lambda (y) (cons x y)))").value());
+    ASSERT_EQ(lambda->functions.size() , 1);
+    auto & outer = *lambda->functions[0]->compiled;
+    ASSERT_EQ(outer.functions.size() , 1);
+    auto & inner = *outer.functions[0]->compiled;
+    ASSERT_EQ(inner.captures.size() , 1);
+    EXPECT_EQ(inner.captures[0].name , "x");
+    EXPECT_TRUE(inner.captures[0].from_local);
+
+    // a malformed form compiles to a failure , raised once it runs
+    auto bad = vm::compile(ast::parse("(cond (#t 1))").value());
+    ASSERT_EQ(bad->failures.size() , 1);
+    EXPECT_TRUE(bad->failures[0].syntax);
+    EXPECT_NE(vm::disassemble(*bad).find("fail") , std::string::npos);
+    EXPECT_EQ(vm::compile(ast::parse("(lambda (1) 1)").value())->failures.size() , 1);
+    auto logic = vm::compile(ast::parse("(and)").value());
+    ASSERT_EQ(logic->failures.size() , 1);
+    EXPECT_FALSE(logic->failures[0].syntax);
+}
+
+TEST(test_vm , test_same_as_tree_walk){
+    Runtime::eval(R"(
+        (define member?
+            (lambda (a lat)
+            (cond
+                ((null? lat) #f)
+                (else (or (eq? (car lat) a) (member? a (cdr lat)))))))
+    )");
+    Runtime::eval(R"(
+        (define pick
+            (lambda (n lat)
+            (cond
+                ((zero? (sub1 n)) (car lat))
+                (else (pick (sub1 n) (cdr lat))))))
+    )");
+
+    std::vector cases{
+        "(member? 'tea '(coffee tea or milk))"sv,
+        "(member? 'a '())"sv,
+        "(pick 3 '(lasagna spaghetti ravioli macaroni meatball))"sv,
+        "((lambda (x y) (cons y x)) '(b) 'a)"sv,
+        "(((lambda (x) (lambda (y) (cons x y))) 'a) '(b))"sv,
+        "(and 1 #f 2)"sv,
+        "(or #f 1)"sv,
+        "(eval '(car '(a b)))"sv,
+        "'(a 'b)"sv,
+        "''1"sv,
+        // () is an error only once evaluated
+        "((lambda (x) (cond (x 1) (else ()))) #t)"sv,
+    };
+
+    for(auto in : cases){
+        EXPECT_EQ(Runtime::eval(in , eval_mode::bytecode) , Runtime::eval(in , eval_mode::tree_walk)) << in;
+    }
+    for(auto mode : {eval_mode::bytecode , eval_mode::tree_walk})
+        EXPECT_THROW(Runtime::eval("((lambda (x) (cond (x ()) (else 1))) #t)" , mode) , runtime_error);
+
+    // malformed forms in code that never runs , errors only when reached
+    for(auto mode : {eval_mode::bytecode , eval_mode::tree_walk}){
+        EXPECT_NO_THROW(Runtime::eval("(define never-cond (lambda (x) (cond)))" , mode));
+        EXPECT_THROW(Runtime::eval("(never-cond 1)" , mode) , bad_syntax);
+        EXPECT_EQ(Runtime::eval("((lambda (x) (cond (x 1) (else (lambda (1) 1)))) #t)" , mode) , "1");
+        EXPECT_EQ(Runtime::eval("((lambda (x) (cond (x 1) (else (define)))) #t)" , mode) , "1");
+        EXPECT_EQ(Runtime::eval("((lambda (x) (cond (x 1) (else (and)))) #t)" , mode) , "1");
+    }
+}
+
+TEST(test_vm , test_currying){
+    Runtime::eval("(define pair (lambda (a b) (cons a (cons b '()))))");
+    Runtime::eval("(define first-is-x (pair 'x))");
+
+    EXPECT_EQ(Runtime::eval("(first-is-x 'y)") , "'(x y)");
+    EXPECT_EQ(Runtime::eval("((pair) 'a 'b)") , "'(a b)");
+    EXPECT_EQ(Runtime::eval("((cons 'a) '(b))") , "'(a b)");
+    EXPECT_ANY_THROW(Runtime::eval("(first-is-x 'y 'z)"));
+    EXPECT_ANY_THROW(Runtime::eval("(1 2)"));
+    EXPECT_ANY_THROW(Runtime::eval("(undefined-function 2)"));
+
+    // the value stack is unwound after an error
+    EXPECT_EQ(Runtime::eval("(first-is-x 'z)") , "'(x z)");
+}
+
+TEST(test_vm , test_deep_recursion){
+    Runtime::eval(R"(
+        (define plus
+            (lambda (n m)
+            (cond
+                ((zero? m) n)
+                (else (add1 (plus n (sub1 m)))))))
+    )");
+
+    // far beyond what the native stack can hold
+    EXPECT_EQ(Runtime::eval("(plus 1 200000)" , eval_mode::bytecode) , "200001");
+
+    auto depth = Runtime::max_depth();
+    Runtime::set_max_depth(1000);
+    EXPECT_THROW(Runtime::eval("(plus 1 5000)" , eval_mode::bytecode) , runtime_error);
+    EXPECT_EQ(Runtime::eval("(plus 1 500)" , eval_mode::bytecode) , "501");
+    Runtime::set_max_depth(depth);
+
+    // the tree walker recurses natively , under a limit of its own
+    Runtime::eval(R"(
+        (define walk-plus
+            (lambda (n m)
+            (cond
+                ((zero? m) n)
+                (else (add1 (walk-plus n (sub1 m)))))))
+    )" , eval_mode::tree_walk);
+    auto native = Runtime::max_native_depth();
+    EXPECT_THROW(Runtime::eval("(walk-plus 1 200000)" , eval_mode::tree_walk) , runtime_error);
+    Runtime::set_max_native_depth(100);
+    EXPECT_THROW(Runtime::eval("(walk-plus 1 500)" , eval_mode::tree_walk) , runtime_error);
+    EXPECT_EQ(Runtime::eval("(walk-plus 1 50)" , eval_mode::tree_walk) , "51");
+    Runtime::set_max_native_depth(native);
+    EXPECT_EQ(Runtime::eval("(walk-plus 1 500)" , eval_mode::tree_walk) , "501");
+}
+
+TEST(test_vm , test_global_cache){
+    Runtime::eval("(define which (lambda (x) 'first))");
+    Runtime::eval("(define call-which (lambda (x) (which x)))");
+    EXPECT_EQ(Runtime::eval("(call-which 1)") , "'first");
+    EXPECT_EQ(Runtime::eval("(call-which 1)") , "'first");
+
+    // redefinition invalidates the cached binding
+    Runtime::eval("(define which (lambda (x) 'second))");
+    EXPECT_EQ(Runtime::eval("(call-which 1)") , "'second");
+
+    // so does binding a name that was undefined when first looked up
+    Runtime::eval("(define call-later (lambda (x) (defined-later x)))");
+    EXPECT_THROW(Runtime::eval("(call-later 1)") , runtime_error);
+    Runtime::eval("(define defined-later (lambda (x) (add1 x)))");
+    EXPECT_EQ(Runtime::eval("(call-later 1)") , "2");
+
+    // one cache per reference
+    auto fn = vm::compile(ast::parse("(cons car car)").value());
+    ASSERT_EQ(fn->globals.size() , 3);
+    EXPECT_EQ(fn->globals[0].value , nullptr);
+}